@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <cassert>
+
+#include "dnacache.h"
+
+using namespace std;
+using namespace hal;
+
+const hal_index_t DNACache::PageSize = 1 << 16;
+
+DNACache::DNACache(size_t maxBytes) : _maxBytes(maxBytes), _bytes(0),
+                                      _hits(0), _misses(0)
+{
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+DNACache::~DNACache()
+{
+  pthread_mutex_destroy(&_mutex);
+}
+
+void DNACache::setMaxBytes(size_t maxBytes)
+{
+  clear();
+  _maxBytes = maxBytes;
+}
+
+void DNACache::clear()
+{
+  pthread_mutex_lock(&_mutex);
+  _pages.clear();
+  _pageMap.clear();
+  _bytes = 0;
+  _hits = 0;
+  _misses = 0;
+  pthread_mutex_unlock(&_mutex);
+}
+
+size_t DNACache::getNumHits() const
+{
+  pthread_mutex_lock(&_mutex);
+  size_t hits = _hits;
+  pthread_mutex_unlock(&_mutex);
+  return hits;
+}
+
+size_t DNACache::getNumMisses() const
+{
+  pthread_mutex_lock(&_mutex);
+  size_t misses = _misses;
+  pthread_mutex_unlock(&_mutex);
+  return misses;
+}
+
+void DNACache::getSubString(const Sequence* sequence, const Sequence* handle,
+                            hal_index_t pos, hal_index_t length,
+                            string& outDNA)
+{
+  assert(pos >= 0 && length >= 0);
+  assert(pos + length <= (hal_index_t)handle->getSequenceLength());
+  if (_maxBytes == 0)
+  {
+    readDNA(handle, pos, length, outDNA);
+    return;
+  }
+  outDNA.erase();
+  outDNA.reserve(length);
+  hal_index_t end = pos + length;
+  for (hal_index_t page = pos / PageSize; page * PageSize < end; ++page)
+  {
+    hal_index_t pageStart = page * PageSize;
+    appendPage(sequence, handle, page, max(pos, pageStart) - pageStart,
+               min(end, pageStart + PageSize) - pageStart, outDNA);
+  }
+}
+
+void DNACache::appendPage(const Sequence* sequence, const Sequence* handle,
+                          hal_index_t page, hal_index_t start, hal_index_t end,
+                          string& outDNA)
+{
+  PageKey key;
+  key._genome = sequence->getGenome();
+  key._sequence = sequence->getArrayIndex();
+  key._page = page;
+
+  pthread_mutex_lock(&_mutex);
+  PageMap::iterator i = _pageMap.find(key);
+  if (i != _pageMap.end())
+  {
+    ++_hits;
+    _pages.splice(_pages.begin(), _pages, i->second);
+    outDNA.append(i->second->_dna, start, end - start);
+    pthread_mutex_unlock(&_mutex);
+    return;
+  }
+  ++_misses;
+  pthread_mutex_unlock(&_mutex);
+
+  // read outside the lock, so other threads aren't held up by HDF5
+  Page newPage;
+  newPage._key = key;
+  hal_index_t pageStart = page * PageSize;
+  hal_index_t pageLength = min(PageSize, (hal_index_t)
+                               handle->getSequenceLength() - pageStart);
+  readDNA(handle, pageStart, pageLength, newPage._dna);
+  outDNA.append(newPage._dna, start, end - start);
+
+  pthread_mutex_lock(&_mutex);
+  // another thread may have read the same page meanwhile
+  if (_pageMap.find(key) == _pageMap.end())
+  {
+    _pages.push_front(Page());
+    _pages.front()._key = key;
+    _pages.front()._dna.swap(newPage._dna);
+    _pageMap.insert(pair<PageKey, PageList::iterator>(key, _pages.begin()));
+    _bytes += _pages.front()._dna.length();
+    while (_bytes > _maxBytes && _pages.size() > 1)
+    {
+      _bytes -= _pages.back()._dna.length();
+      _pageMap.erase(_pages.back()._key);
+      _pages.pop_back();
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+void DNACache::readDNA(const Sequence* handle, hal_index_t pos,
+                       hal_index_t length, string& outDNA) const
+{
+  handle->getSubString(outDNA, pos, length);
+}
+
+RootDNACache::RootDNACache(size_t maxBytes) : DNACache(maxBytes)
+{
+}
+
+void RootDNACache::readDNA(const Sequence* handle, hal_index_t pos,
+                           hal_index_t length, string& outDNA) const
+{
+  outDNA.erase();
+  if (length == 0)
+  {
+    return;
+  }
+  const Genome* root = handle->getGenome();
+  assert(root->getParent() == NULL);
+  hal_index_t first = handle->getStartPosition() + pos;
+  hal_index_t last = first + length - 1;
+  BottomSegmentIteratorPtr bottom = root->getBottomSegmentIterator();
+  TopSegmentIteratorPtr top = root->getChild(0)->getTopSegmentIterator();
+  string buffer;
+  bottom->toSite(first, false);
+  while (true)
+  {
+    // copy the (sliced) segment up from the first child that has it
+    hal_index_t segStart = bottom->getStartPosition();
+    hal_index_t segEnd = bottom->getEndPosition();
+    bottom->slice(max(first, segStart) - segStart,
+                  segEnd - min(last, segEnd));
+    for (size_t j = 0; j < root->getNumChildren(); ++j)
+    {
+      if (bottom->getBottomSegment()->hasChild(j))
+      {
+        top->toChild(bottom, j);
+        top->getString(buffer);
+        outDNA.append(buffer);
+        break;
+      }
+      assert(j != root->getNumChildren() - 1);
+    }
+    if (segEnd >= last)
+    {
+      break;
+    }
+    bottom->slice(0, 0);
+    bottom->toRight();
+  }
+  assert((hal_index_t)outDNA.length() == length);
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _DNACACHE_H
+#define _DNACACHE_H
+
+#include <string>
+#include <list>
+#include <map>
+#include <pthread.h>
+
+#include "hal.h"
+
+/*
+ * Read-through cache of HAL DNA, in pages of PageSize bases keyed by 
+ * (genome, sequence, page) of the reader 0 sequence, with the least
+ * recently used pages dropped once the total size goes over the limit.
+ * The same (target) ranges get read over and over again while mapping,
+ * and this saves going back to HDF5 each time.
+ *
+ * Safe to use from several threads at once.  Only the key (genome 
+ * pointer and array index) is taken from the reader 0 sequence: the DNA
+ * (and length) are read outside the lock, through whatever HAL handle 
+ * the calling thread owns.
+ */
+class DNACache
+{
+public:
+
+   static const hal_index_t PageSize;
+
+   DNACache(size_t maxBytes = 0);
+   virtual ~DNACache();
+
+   /** Set the size limit (0 disables the cache) and empty it */
+   void setMaxBytes(size_t maxBytes);
+   size_t getMaxBytes() const;
+   void clear();
+
+   /** Get length bases from pos of sequence (from reader 0).  Missing 
+    * pages are read through handle, which must be the same sequence 
+    * in the calling thread's HAL reader */
+   void getSubString(const hal::Sequence* sequence, 
+                     const hal::Sequence* handle,
+                     hal_index_t pos, hal_index_t length,
+                     std::string& outDNA);
+
+   /** Number of pages found in, or read into, the cache */
+   size_t getNumHits() const;
+   size_t getNumMisses() const;
+   
+protected:
+
+   struct PageKey
+   {
+      const hal::Genome* _genome;
+      hal_size_t _sequence;
+      hal_index_t _page;
+      bool operator<(const PageKey& other) const;
+   };
+   struct Page
+   {
+      PageKey _key;
+      std::string _dna;
+   };
+   typedef std::list<Page> PageList;
+   typedef std::map<PageKey, PageList::iterator> PageMap;
+
+   /** Read bases that aren't cached (called outside the lock) */
+   virtual void readDNA(const hal::Sequence* handle, hal_index_t pos,
+                        hal_index_t length, std::string& outDNA) const;
+
+   /** Append the bases [start, end) of a page to outDNA, reading it in
+    * if needs be */
+   void appendPage(const hal::Sequence* sequence, 
+                   const hal::Sequence* handle, hal_index_t page,
+                   hal_index_t start, hal_index_t end, std::string& outDNA);
+   
+protected:
+
+   size_t _maxBytes;
+   size_t _bytes;
+   // most recently used first
+   PageList _pages;
+   PageMap _pageMap;
+   size_t _hits;
+   size_t _misses;
+   mutable pthread_mutex_t _mutex;
+};
+
+/*
+ * DNACache for the root genome of a CAMEL alignment, whose DNA is all Ns
+ * in the HAL file.  We know that there are no substitutions, so pages are 
+ * inferred from the children instead: only the bottom segments overlapping
+ * a missing page get resolved.
+ */
+class RootDNACache : public DNACache
+{
+public:
+   RootDNACache(size_t maxBytes = 0);
+
+protected:
+
+   void readDNA(const hal::Sequence* handle, hal_index_t pos,
+                hal_index_t length, std::string& outDNA) const;
+};
+
+inline bool DNACache::PageKey::operator<(const DNACache::PageKey& other) const
+{
+  if (_genome != other._genome)
+  {
+    return _genome < other._genome;
+  }
+  if (_sequence != other._sequence)
+  {
+    return _sequence < other._sequence;
+  }
+  return _page < other._page;
+}
+
+inline size_t DNACache::getMaxBytes() const
+{
+  return _maxBytes;
+}
+
+#endif
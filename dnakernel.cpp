@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <cctype>
+#include <cassert>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "dnakernel.h"
+
+using namespace std;
+
+/** Accumulate runs as we scan positions left to right */
+class MismatchRunBuilder
+{
+public:
+   MismatchRunBuilder(vector<DNAMismatchRun>& runs) :
+     _runs(runs), _inRun(false), _start(0) {}
+
+   void match(size_t pos) 
+   {
+     if (_inRun == true)
+     {
+       close(pos);
+     }
+   }
+   void mismatch(size_t pos)
+   {
+     if (_inRun == false)
+     {
+       _inRun = true;
+       _start = pos;
+     }
+   }
+   void bits(size_t pos, unsigned int eqMask, size_t width)
+   {
+     for (size_t j = 0; j < width; ++j)
+     {
+       if ((eqMask >> j) & 1U)
+       {
+         match(pos + j);
+       }
+       else
+       {
+         mismatch(pos + j);
+       }
+     }
+   }
+   void close(size_t pos)
+   {
+     DNAMismatchRun run;
+     run._start = _start;
+     run._length = pos - _start;
+     _runs.push_back(run);
+     _inRun = false;
+   }
+   void finish(size_t length)
+   {
+     if (_inRun == true)
+     {
+       close(length);
+     }
+   }
+
+protected:
+   vector<DNAMismatchRun>& _runs;
+   bool _inRun;
+   size_t _start;
+};
+
+// Case folding for the vector loops maps A-Z to a-z and leaves all other
+// bytes alone, so folded bytes are equal exactly when toupper()'d
+// bytes are.
+
+#if defined(__AVX2__)
+static inline __m256i foldCase(__m256i v)
+{
+  __m256i isUpper = _mm256_and_si256(
+    _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+    _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+  return _mm256_or_si256(v, _mm256_and_si256(isUpper,
+                                             _mm256_set1_epi8(0x20)));
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i foldCase(__m128i v)
+{
+  __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  return _mm_or_si128(v, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+void findDNAMismatchRuns(const char* src, const char* tgt, size_t length,
+                         bool caseSensitive,
+                         vector<DNAMismatchRun>& outRuns)
+{
+  outRuns.clear();
+  MismatchRunBuilder runs(outRuns);
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+    __m256i t = _mm256_loadu_si256((const __m256i*)(tgt + i));
+    if (caseSensitive == false)
+    {
+      s = foldCase(s);
+      t = foldCase(t);
+    }
+    unsigned int eqMask = (unsigned int)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(s, t));
+    if (eqMask == 0xFFFFFFFFU)
+    {
+      runs.match(i);
+    }
+    else
+    {
+      runs.bits(i, eqMask, 32);
+    }
+  }
+#endif
+
+#if defined(__SSE2__)
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i t = _mm_loadu_si128((const __m128i*)(tgt + i));
+    if (caseSensitive == false)
+    {
+      s = foldCase(s);
+      t = foldCase(t);
+    }
+    unsigned int eqMask = (unsigned int)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(s, t));
+    if (eqMask == 0xFFFFU)
+    {
+      runs.match(i);
+    }
+    else
+    {
+      runs.bits(i, eqMask, 16);
+    }
+  }
+#endif
+
+  for (; i < length; ++i)
+  {
+    bool sub = caseSensitive ? src[i] != tgt[i] :
+       toupper(src[i]) != toupper(tgt[i]);
+    if (sub == true)
+    {
+      runs.mismatch(i);
+    }
+    else
+    {
+      runs.match(i);
+    }
+  }
+  runs.finish(length);
+}
+
+void findDNAMismatchRuns(const string& src, const string& tgt,
+                         bool reversed, bool caseSensitive,
+                         vector<DNAMismatchRun>& outRuns)
+{
+  assert(src.length() == tgt.length());
+  if (reversed == false)
+  {
+    findDNAMismatchRuns(src.data(), tgt.data(), src.length(), caseSensitive,
+                        outRuns);
+  }
+  else
+  {
+    string tgtRC(tgt.length(), 'N');
+    if (tgt.empty() == false)
+    {
+      reverseComplementDNA(tgt.data(), tgt.length(), &tgtRC[0]);
+    }
+    findDNAMismatchRuns(src.data(), tgtRC.data(), src.length(), caseSensitive,
+                        outRuns);
+  }
+}
+
+// Vector reverse complement:  bytes are complemented with the same xor
+// trick as complementDNA() (A^T == 0x15, C^G == 0x04, and 0x20 doesn't
+// change either), then reversed with a shuffle.
+
+#if defined(__AVX2__)
+static inline __m256i revCompVector(__m256i v)
+{
+  __m256i lc = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i at = _mm256_or_si256(_mm256_cmpeq_epi8(lc, _mm256_set1_epi8('a')),
+                               _mm256_cmpeq_epi8(lc, _mm256_set1_epi8('t')));
+  __m256i cg = _mm256_or_si256(_mm256_cmpeq_epi8(lc, _mm256_set1_epi8('c')),
+                               _mm256_cmpeq_epi8(lc, _mm256_set1_epi8('g')));
+  __m256i mask = _mm256_or_si256(
+    _mm256_and_si256(at, _mm256_set1_epi8(0x15)),
+    _mm256_and_si256(cg, _mm256_set1_epi8(0x04)));
+  v = _mm256_xor_si256(v, mask);
+  // reverse within each 128-bit lane then swap the lanes
+  v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                              7, 6, 5, 4, 3, 2, 1, 0,
+                                              15, 14, 13, 12, 11, 10, 9, 8,
+                                              7, 6, 5, 4, 3, 2, 1, 0));
+  return _mm256_permute2x128_si256(v, v, 0x01);
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i revCompVector(__m128i v)
+{
+  __m128i lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i at = _mm_or_si128(_mm_cmpeq_epi8(lc, _mm_set1_epi8('a')),
+                            _mm_cmpeq_epi8(lc, _mm_set1_epi8('t')));
+  __m128i cg = _mm_or_si128(_mm_cmpeq_epi8(lc, _mm_set1_epi8('c')),
+                            _mm_cmpeq_epi8(lc, _mm_set1_epi8('g')));
+  __m128i mask = _mm_or_si128(_mm_and_si128(at, _mm_set1_epi8(0x15)),
+                              _mm_and_si128(cg, _mm_set1_epi8(0x04)));
+  v = _mm_xor_si128(v, mask);
+#if defined(__SSSE3__)
+  return _mm_shuffle_epi8(v, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0));
+#else
+  // reverse 32-bit words, then 16-bit words in them, then bytes in those
+  v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+#endif
+}
+#endif
+
+void reverseComplementDNA(const char* in, size_t length, char* out)
+{
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + length - i - 32));
+    _mm256_storeu_si256((__m256i*)(out + i), revCompVector(v));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)(in + length - i - 16));
+    _mm_storeu_si128((__m128i*)(out + i), revCompVector(v));
+  }
+#endif
+  for (; i < length; ++i)
+  {
+    out[i] = complementDNA(in[length - 1 - i]);
+  }
+}
+
+void reverseComplementDNA(char* dna, size_t length)
+{
+  // swap chunks from both ends towards the middle
+  size_t i = 0;
+  size_t j = length;
+#if defined(__AVX2__)
+  for (; j - i >= 64; i += 32, j -= 32)
+  {
+    __m256i front = _mm256_loadu_si256((const __m256i*)(dna + i));
+    __m256i back = _mm256_loadu_si256((const __m256i*)(dna + j - 32));
+    _mm256_storeu_si256((__m256i*)(dna + i), revCompVector(back));
+    _mm256_storeu_si256((__m256i*)(dna + j - 32), revCompVector(front));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; j - i >= 32; i += 16, j -= 16)
+  {
+    __m128i front = _mm_loadu_si128((const __m128i*)(dna + i));
+    __m128i back = _mm_loadu_si128((const __m128i*)(dna + j - 16));
+    _mm_storeu_si128((__m128i*)(dna + i), revCompVector(back));
+    _mm_storeu_si128((__m128i*)(dna + j - 16), revCompVector(front));
+  }
+#endif
+  // (the middle base, if any, gets complemented when i == j)
+  for (; i < j; ++i)
+  {
+    --j;
+    char front = complementDNA(dna[i]);
+    dna[i] = complementDNA(dna[j]);
+    dna[j] = front;
+  }
+}
+
+void reverseComplementDNA(string& dna)
+{
+  if (dna.empty() == false)
+  {
+    reverseComplementDNA(&dna[0], dna.length());
+  }
+}
+
+bool isAllN(const char* dna, size_t length)
+{
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i v = _mm256_or_si256(
+      _mm256_loadu_si256((const __m256i*)(dna + i)), _mm256_set1_epi8(0x20));
+    if ((unsigned int)_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('n'))) != 0xFFFFFFFFU)
+    {
+      return false;
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i*)(dna + i)),
+                             _mm_set1_epi8(0x20));
+    if ((unsigned int)_mm_movemask_epi8(
+          _mm_cmpeq_epi8(v, _mm_set1_epi8('n'))) != 0xFFFFU)
+    {
+      return false;
+    }
+  }
+#endif
+  for (; i < length; ++i)
+  {
+    if (toupper(dna[i]) != 'N')
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _DNAKERNEL_H
+#define _DNAKERNEL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Vectorized (SSE2, or AVX2 / SSSE3 when built with SIMD=avx2 / ssse3,
+ * see include.mk) loops over DNA strings for the hot spots of the 
+ * conversion.  Results are always the same as the scalar versions.
+ */
+
+/** Run of consecutive mismatching positions [_start, _start + _length) */
+struct DNAMismatchRun
+{
+   size_t _start;
+   size_t _length;
+};
+
+/** Find all runs of mismatches between src and tgt (which must have the
+ * same length), in order.  If reversed is true, src is compared
+ * to the reverse complement of tgt instead.  Mismatches are defined
+ * as in SNPHandler::isSub() (ie toupper is used when not case sensitive)
+ */
+void findDNAMismatchRuns(const std::string& src, const std::string& tgt,
+                         bool reversed, bool caseSensitive,
+                         std::vector<DNAMismatchRun>& outRuns);
+
+/** Same as above, on raw (forward) buffers of length bases */
+void findDNAMismatchRuns(const char* src, const char* tgt, size_t length,
+                         bool caseSensitive,
+                         std::vector<DNAMismatchRun>& outRuns);
+
+/** Complement of a base.  Same as hal::reverseComplement(char):  
+ * only ACGT (upper or lower case) are changed */
+inline char complementDNA(char c)
+{
+  char lc = c | 0x20;
+  if (lc == 'a' || lc == 't')
+  {
+    return c ^ 0x15;
+  }
+  else if (lc == 'c' || lc == 'g')
+  {
+    return c ^ 0x04;
+  }
+  return c;
+}
+
+/** Reverse complement a string in place (like hal::reverseComplement) */
+void reverseComplementDNA(std::string& dna);
+void reverseComplementDNA(char* dna, size_t length);
+
+/** Write the reverse complement of in[0, length) to out[0, length) 
+ * (buffers must not overlap) */
+void reverseComplementDNA(const char* in, size_t length, char* out);
+
+/** Check if all length bases of dna are N (upper or lower case).  Stops
+ * at the first other base */
+bool isAllN(const char* dna, size_t length);
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <limits>
+#include <cassert>
+
+#include "genometreeindex.h"
+
+using namespace std;
+using namespace hal;
+
+const size_t GenomeTreeIndex::NoNode = numeric_limits<size_t>::max();
+
+GenomeTreeIndex::GenomeTreeIndex()
+{
+
+}
+
+GenomeTreeIndex::~GenomeTreeIndex()
+{
+
+}
+
+void GenomeTreeIndex::clear()
+{
+  _genomes.clear();
+  _nodeMap.clear();
+  _parent.clear();
+  _children.clear();
+  _depth.clear();
+  _euler.clear();
+  _first.clear();
+  _sparse.clear();
+  _log2.clear();
+  _centroids.clear();
+  _bestNode.clear();
+  _bestDist.clear();
+  _secondNode.clear();
+  _secondDist.clear();
+  _marked.clear();
+}
+
+void GenomeTreeIndex::init(const Genome* root)
+{
+  clear();
+  assert(root != NULL);
+  addNode(root, NoNode, 0);
+  buildSparseTable();
+  buildCentroids();
+  _bestNode.assign(_genomes.size(), NoNode);
+  _bestDist.assign(_genomes.size(), NoNode);
+  _secondNode.assign(_genomes.size(), NoNode);
+  _secondDist.assign(_genomes.size(), NoNode);
+  _marked.assign(_genomes.size(), false);
+}
+
+void GenomeTreeIndex::addNode(const Genome* genome, size_t parent,
+                              size_t depth)
+{
+  size_t node = _genomes.size();
+  _genomes.push_back(genome);
+  _nodeMap.insert(pair<const Genome*, size_t>(genome, node));
+  _parent.push_back(parent);
+  _children.push_back(vector<size_t>());
+  _depth.push_back(depth);
+  _first.push_back(_euler.size());
+  _euler.push_back(node);
+  for (hal_size_t i = 0; i < genome->getNumChildren(); ++i)
+  {
+    size_t child = _genomes.size();
+    _children[node].push_back(child);
+    addNode(genome->getChild(i), node, depth + 1);
+    _euler.push_back(node);
+  }
+}
+
+void GenomeTreeIndex::buildSparseTable()
+{
+  size_t n = _euler.size();
+  _log2.assign(n + 1, 0);
+  for (size_t i = 2; i <= n; ++i)
+  {
+    _log2[i] = _log2[i / 2] + 1;
+  }
+  _sparse.assign(1, _euler);
+  for (size_t k = 1; ((size_t)1 << k) <= n; ++k)
+  {
+    const vector<size_t>& prev = _sparse[k - 1];
+    size_t half = (size_t)1 << (k - 1);
+    vector<size_t> cur(n - ((size_t)1 << k) + 1);
+    for (size_t i = 0; i < cur.size(); ++i)
+    {
+      size_t a = prev[i];
+      size_t b = prev[i + half];
+      cur[i] = _depth[a] <= _depth[b] ? a : b;
+    }
+    _sparse.push_back(cur);
+  }
+}
+
+void GenomeTreeIndex::getNeighbours(size_t node,
+                                    vector<size_t>& outNeighbours) const
+{
+  outNeighbours = _children[node];
+  if (_parent[node] != NoNode)
+  {
+    outNeighbours.push_back(_parent[node]);
+  }
+}
+
+void GenomeTreeIndex::buildCentroids()
+{
+  size_t n = _genomes.size();
+  _centroids.assign(n, vector<pair<size_t, size_t> >());
+  vector<bool> removed(n, false);
+  vector<size_t> size(n, 0);
+  vector<size_t> from(n, NoNode);
+  vector<size_t> neighbours;
+  
+  // components still to decompose, by any node in them
+  vector<size_t> stack(1, 0);
+  while (stack.empty() == false)
+  {
+    size_t start = stack.back();
+    stack.pop_back();
+
+    // list the component in bfs order from start
+    vector<size_t> order(1, start);
+    from[start] = NoNode;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+      getNeighbours(order[i], neighbours);
+      for (size_t j = 0; j < neighbours.size(); ++j)
+      {
+        if (!removed[neighbours[j]] && neighbours[j] != from[order[i]])
+        {
+          from[neighbours[j]] = order[i];
+          order.push_back(neighbours[j]);
+        }
+      }
+    }
+    // subtree sizes (relative to start) in reverse bfs order
+    for (size_t i = order.size(); i > 0; --i)
+    {
+      size_t node = order[i - 1];
+      size[node] = 1;
+      getNeighbours(node, neighbours);
+      for (size_t j = 0; j < neighbours.size(); ++j)
+      {
+        if (!removed[neighbours[j]] && neighbours[j] != from[node])
+        {
+          size[node] += size[neighbours[j]];
+        }
+      }
+    }
+    // centroid: no remaining piece has more than half the nodes
+    size_t total = order.size();
+    size_t centroid = start;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+      size_t node = order[i];
+      size_t biggest = total - size[node];
+      getNeighbours(node, neighbours);
+      for (size_t j = 0; j < neighbours.size(); ++j)
+      {
+        if (!removed[neighbours[j]] && neighbours[j] != from[node])
+        {
+          biggest = max(biggest, size[neighbours[j]]);
+        }
+      }
+      if (2 * biggest <= total)
+      {
+        centroid = node;
+        break;
+      }
+    }
+
+    // record distances from the centroid to everything in the component
+    vector<size_t> bfs(1, centroid);
+    vector<size_t> dist(1, 0);
+    from[centroid] = NoNode;
+    for (size_t i = 0; i < bfs.size(); ++i)
+    {
+      _centroids[bfs[i]].push_back(pair<size_t, size_t>(centroid, dist[i]));
+      getNeighbours(bfs[i], neighbours);
+      for (size_t j = 0; j < neighbours.size(); ++j)
+      {
+        if (!removed[neighbours[j]] && neighbours[j] != from[bfs[i]])
+        {
+          from[neighbours[j]] = bfs[i];
+          bfs.push_back(neighbours[j]);
+          dist.push_back(dist[i] + 1);
+        }
+      }
+    }
+    
+    removed[centroid] = true;
+    getNeighbours(centroid, neighbours);
+    for (size_t j = 0; j < neighbours.size(); ++j)
+    {
+      if (!removed[neighbours[j]])
+      {
+        stack.push_back(neighbours[j]);
+      }
+    }
+  }
+}
+
+size_t GenomeTreeIndex::getNode(const Genome* genome) const
+{
+  map<const Genome*, size_t>::const_iterator i = _nodeMap.find(genome);
+  if (i == _nodeMap.end())
+  {
+    throw hal_exception("Genome " + genome->getName() + 
+                        " not found in tree index");
+  }
+  return i->second;
+}
+
+size_t GenomeTreeIndex::getLCANode(size_t node1, size_t node2) const
+{
+  size_t left = min(_first[node1], _first[node2]);
+  size_t right = max(_first[node1], _first[node2]) + 1;
+  size_t k = _log2[right - left];
+  size_t a = _sparse[k][left];
+  size_t b = _sparse[k][right - ((size_t)1 << k)];
+  return _depth[a] <= _depth[b] ? a : b;
+}
+
+size_t GenomeTreeIndex::getNodeDistance(size_t node1, size_t node2) const
+{
+  return _depth[node1] + _depth[node2] - 
+     2 * _depth[getLCANode(node1, node2)];
+}
+
+const Genome* 
+GenomeTreeIndex::getLowestCommonAncestor(const Genome* genome1,
+                                         const Genome* genome2) const
+{
+  return _genomes[getLCANode(getNode(genome1), getNode(genome2))];
+}
+
+size_t GenomeTreeIndex::getDistance(const Genome* genome1,
+                                   const Genome* genome2) const
+{
+  return getNodeDistance(getNode(genome1), getNode(genome2));
+}
+
+bool GenomeTreeIndex::closer(size_t dist1, size_t node1,
+                             size_t dist2, size_t node2) const
+{
+  if (node2 == NoNode)
+  {
+    return node1 != NoNode;
+  }
+  if (node1 == NoNode)
+  {
+    return false;
+  }
+  if (dist1 != dist2)
+  {
+    return dist1 < dist2;
+  }
+  return _genomes[node1]->getName() < _genomes[node2]->getName();
+}
+
+void GenomeTreeIndex::updateBest(size_t centroid, size_t node, size_t dist)
+{
+  if (closer(dist, node, _bestDist[centroid], _bestNode[centroid]))
+  {
+    _secondDist[centroid] = _bestDist[centroid];
+    _secondNode[centroid] = _bestNode[centroid];
+    _bestDist[centroid] = dist;
+    _bestNode[centroid] = node;
+  }
+  else if (closer(dist, node, _secondDist[centroid], _secondNode[centroid]))
+  {
+    _secondDist[centroid] = dist;
+    _secondNode[centroid] = node;
+  }
+}
+
+void GenomeTreeIndex::mark(const Genome* genome)
+{
+  size_t node = getNode(genome);
+  if (_marked[node] == true)
+  {
+    return;
+  }
+  _marked[node] = true;
+  const vector<pair<size_t, size_t> >& centroids = _centroids[node];
+  for (size_t i = 0; i < centroids.size(); ++i)
+  {
+    updateBest(centroids[i].first, node, centroids[i].second);
+  }
+}
+
+bool GenomeTreeIndex::isMarked(const Genome* genome) const
+{
+  return _marked[getNode(genome)];
+}
+
+const Genome* GenomeTreeIndex::getNearestMarked(const Genome* genome) const
+{
+  size_t node = getNode(genome);
+  size_t best = NoNode;
+  size_t bestDist = NoNode;
+  // the path to the nearest genome goes through one of our centroids
+  // (the others can only give distances that are too big)
+  const vector<pair<size_t, size_t> >& centroids = _centroids[node];
+  for (size_t i = 0; i < centroids.size(); ++i)
+  {
+    size_t centroid = centroids[i].first;
+    size_t candidate = _bestNode[centroid];
+    size_t candidateDist = _bestDist[centroid];
+    if (candidate == node)
+    {
+      candidate = _secondNode[centroid];
+      candidateDist = _secondDist[centroid];
+    }
+    if (candidate != NoNode)
+    {
+      size_t dist = centroids[i].second + candidateDist;
+      if (closer(dist, candidate, bestDist, best))
+      {
+        bestDist = dist;
+        best = candidate;
+      }
+    }
+  }
+  return best == NoNode ? NULL : _genomes[best];
+}
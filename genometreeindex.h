@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _GENOMETREEINDEX_H
+#define _GENOMETREEINDEX_H
+
+#include <vector>
+#include <map>
+#include <utility>
+
+#include "hal.h"
+
+/*
+ * Index of the HAL genome tree, built once, for fast distance queries:
+ *  - lowest common ancestor in O(1) (Euler tour + sparse table range 
+ *    minimum on depth)
+ *  - nearest "marked" genome in O(log n) (centroid decomposition, where
+ *    each centroid remembers the closest marked genome below it)
+ *
+ * Distances are in branches (ie edges), and ties between equally near
+ * genomes are broken by name.
+ */
+class GenomeTreeIndex
+{
+public:
+
+   GenomeTreeIndex();
+   ~GenomeTreeIndex();
+
+   /** Index the tree below (and including) root.  Clears all marks */
+   void init(const hal::Genome* root);
+   void clear();
+
+   const hal::Genome* getLowestCommonAncestor(const hal::Genome* genome1,
+                                              const hal::Genome* genome2) 
+     const;
+   size_t getDistance(const hal::Genome* genome1,
+                      const hal::Genome* genome2) const;
+
+   /** Make genome a candidate for getNearestMarked() */
+   void mark(const hal::Genome* genome);
+   bool isMarked(const hal::Genome* genome) const;
+
+   /** Get the closest marked genome other than genome itself, NULL if
+    * there isn't one */
+   const hal::Genome* getNearestMarked(const hal::Genome* genome) const;
+
+protected:
+
+   static const size_t NoNode;
+
+   size_t getNode(const hal::Genome* genome) const;
+   void addNode(const hal::Genome* genome, size_t parent, size_t depth);
+   size_t getLCANode(size_t node1, size_t node2) const;
+   size_t getNodeDistance(size_t node1, size_t node2) const;
+   bool closer(size_t dist1, size_t node1, size_t dist2, size_t node2) const;
+   void updateBest(size_t centroid, size_t node, size_t dist);
+   void buildSparseTable();
+   void buildCentroids();
+   void getNeighbours(size_t node, std::vector<size_t>& outNeighbours) const;
+
+protected:
+
+   // tree, by node index
+   std::vector<const hal::Genome*> _genomes;
+   std::map<const hal::Genome*, size_t> _nodeMap;
+   std::vector<size_t> _parent;
+   std::vector<std::vector<size_t> > _children;
+   std::vector<size_t> _depth;
+
+   // euler tour (of node indexes) and index of first visit of each node
+   std::vector<size_t> _euler;
+   std::vector<size_t> _first;
+   // _sparse[k][i] is shallowest node in _euler[i, i + 2^k)
+   std::vector<std::vector<size_t> > _sparse;
+   std::vector<size_t> _log2;
+
+   // (centroid, distance to it) for every centroid above each node
+   std::vector<std::vector<std::pair<size_t, size_t> > > _centroids;
+   // two closest marked nodes to each centroid (and their distances). 
+   // need the runner-up for when the query is the closest.
+   std::vector<size_t> _bestNode;
+   std::vector<size_t> _bestDist;
+   std::vector<size_t> _secondNode;
+   std::vector<size_t> _secondDist;
+   std::vector<bool> _marked;
+};
+
+#endif
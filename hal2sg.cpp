@@ -9,6 +9,7 @@
 #include <cassert>
 #include <fstream>
 #include <deque>
+#include <cstdio>
 
 #include "sgbuilder.h"
 #include "halsgsql.h"
@@ -16,7 +17,6 @@
 using namespace std;
 using namespace hal;
 
-static bool isCamelHal(AlignmentConstPtr aligment);
 static void breadthFirstGenomeSearch(const Genome* reference,
                                      const vector<const Genome*>& targets,
                                      vector<const Genome*>& outTraversal);
@@ -52,6 +52,70 @@ static void initParser(CLParser* optionsParser)
                                "default, the UCSC convention of "
                                "Genome.Sequence is used",
                                false);
+  optionsParser->addOptionFlag("stripSeqNames",
+                               "leave the names of all side graph sequences"
+                               " empty",
+                               false);
+  optionsParser->addOptionFlag("parallelClades",
+                               "build each clade below the reference into "
+                               "its own graph (in parallel with --numThreads)"
+                               " then merge them.  Sequence IDs are assigned "
+                               "clade by clade so will differ from default.  "
+                               "Genomes reached through the reference's "
+                               "parent form a single clade, so a leaf "
+                               "reference gets no parallelism (the genomes "
+                               "are then added serially)",
+                               false);
+  optionsParser->addOption("numThreads",
+                           "number of threads to use.  Each extra thread "
+                           "opens its own handle to the HAL file",
+                           1);
+  optionsParser->addOption("verify",
+                           "how to check that each output path matches its "
+                           "input sequence: off, sampled (some of the DNA), "
+                           "structural (coordinates, and DNA of SNPs only) "
+                           "or full",
+                           "full");
+  optionsParser->addOption("dnaCacheSize",
+                           "size (in MB) of the cache of HAL DNA reads "
+                           "(0 to disable)",
+                           256);
+  optionsParser->addOption("preloadSize",
+                           "memory (in MB) to use for loading the whole DNA "
+                           "of the genomes mapped onto into memory, 2-bit "
+                           "packed (0 to disable)",
+                           0);
+  optionsParser->addOption("seqDNASize",
+                           "memory (in MB) to use for keeping the DNA of "
+                           "side graph sequences that is read anyway "
+                           "(SNPs and short sequences at export), 2-bit "
+                           "packed, instead of reading it again from HAL "
+                           "(0 to disable)",
+                           0);
+  optionsParser->addOption("maxMemory",
+                           "memory (in MB) to keep the HAL to Side Graph "
+                           "lookups of mapped genomes (plus the DNA kept "
+                           "with --seqDNASize) under.  Lookups that "
+                           "no later genome maps onto are spilled to "
+                           "temporary files past this (0 for no limit)",
+                           0);
+  optionsParser->addOption("checkpoint",
+                           "file to checkpoint the build to after each "
+                           "genome, so it can be continued with --resume "
+                           "(default <sqlFile>.checkpoint).  Deleted "
+                           "once the output is written",
+                           "\"\"");
+  optionsParser->addOptionFlag("noCheckpoint",
+                               "don't write a checkpoint (saves the disk "
+                               "space and time, mostly syncing, it takes)",
+                               false);
+  optionsParser->addOptionFlag("resume",
+                               "continue an interrupted run from the "
+                               "checkpoint it left.  "
+                               "All other options must be the same as the "
+                               "interrupted run.  Not supported with "
+                               "--parallelClades",
+                               false);
 
   optionsParser->setDescription("Convert HAL alignment to GA4GH Side "
                                 "Graph SQL format");
@@ -69,6 +133,18 @@ int main(int argc, char** argv)
   string targetGenomes;
   bool noAncestors;
   bool onlySequenceNames;
+  bool stripSeqNames;
+  int numThreads;
+  bool parallelClades;
+  string verify;
+  int dnaCacheSize;
+  int preloadSize;
+  int seqDNASize;
+  int maxMemory;
+  string checkpointPath;
+  bool noCheckpoint;
+  bool resume;
+  SGBuilder::VerifyLevel verifyLevel = SGBuilder::VerifyFull;
   try
   {
     optionsParser.parseOptions(argc, argv);
@@ -80,6 +156,73 @@ int main(int argc, char** argv)
     targetGenomes = optionsParser.getOption<string>("targetGenomes");
     noAncestors = optionsParser.getFlag("noAncestors");
     onlySequenceNames = optionsParser.getFlag("onlySequenceNames");
+    stripSeqNames = optionsParser.getFlag("stripSeqNames");
+    numThreads = optionsParser.getOption<int>("numThreads");
+    parallelClades = optionsParser.getFlag("parallelClades");
+    verify = optionsParser.getOption<string>("verify");
+    dnaCacheSize = optionsParser.getOption<int>("dnaCacheSize");
+    preloadSize = optionsParser.getOption<int>("preloadSize");
+    seqDNASize = optionsParser.getOption<int>("seqDNASize");
+    maxMemory = optionsParser.getOption<int>("maxMemory");
+    checkpointPath = optionsParser.getOption<string>("checkpoint");
+    noCheckpoint = optionsParser.getFlag("noCheckpoint");
+    resume = optionsParser.getFlag("resume");
+    if (numThreads < 1)
+    {
+      throw hal_exception("--numThreads must be at least 1");
+    }
+    if (dnaCacheSize < 0)
+    {
+      throw hal_exception("--dnaCacheSize cannot be negative");
+    }
+    if (preloadSize < 0)
+    {
+      throw hal_exception("--preloadSize cannot be negative");
+    }
+    if (seqDNASize < 0)
+    {
+      throw hal_exception("--seqDNASize cannot be negative");
+    }
+    if (maxMemory < 0)
+    {
+      throw hal_exception("--maxMemory cannot be negative");
+    }
+    if (resume == true && parallelClades == true)
+    {
+      throw hal_exception("--resume not supported with --parallelClades");
+    }
+    if (resume == true && noCheckpoint == true)
+    {
+      throw hal_exception("--resume and --noCheckpoint options are "
+                          "mutually exclusive");
+    }
+    if (checkpointPath == "\"\"")
+    {
+      checkpointPath = sqlPath + ".checkpoint";
+    }
+    if (parallelClades == true && noCheckpoint == false)
+    {
+      cerr << "Checkpoints are not supported with --parallelClades. "
+           << "Not writing " << checkpointPath << endl;
+      noCheckpoint = true;
+    }
+    if (verify == "off")
+    {
+      verifyLevel = SGBuilder::VerifyOff;
+    }
+    else if (verify == "sampled")
+    {
+      verifyLevel = SGBuilder::VerifySampled;
+    }
+    else if (verify == "structural")
+    {
+      verifyLevel = SGBuilder::VerifyStructural;
+    }
+    else if (verify != "full")
+    {
+      throw hal_exception("--verify must be one of off, sampled, structural"
+                          " or full");
+    }
     if (rootGenomeName != "\"\"" && targetGenomes != "\"\"")
     {
       throw hal_exception("--rootGenome and --targetGenomes options are "
@@ -205,31 +348,98 @@ int main(int argc, char** argv)
     vector<const Genome*> breadthFirstOrdering;
     breadthFirstGenomeSearch(refGenome, targetVec, breadthFirstOrdering);
 
-    bool camelMode = isCamelHal(alignment);
+    SGBuilder sgbuild;
+    sgbuild.init(alignment, rootGenome, false, false,
+                 onlySequenceNames, stripSeqNames);
+    // CAMEL writes the root's DNA sequence as N's.  This screws up SNP 
+    // detection in the conversion when the root is used as the first 
+    // anchor.  So we check if the root's all N's, in which case the
+    // builder infers the root from its children (possible as there are
+    // no substitutions in CAMEL HAL files)
+    bool camelMode = sgbuild.detectCamelMode();
+    cerr << "CAMEL check: " << sgbuild.getCamelCheckSeconds() << "s" 
+         << endl;
     if (camelMode)
     {
       cout << "CAMEL output detected.  Will infer root sequence "
            << "from children" << endl;
     }
-    SGBuilder sgbuild;
-    sgbuild.init(alignment, rootGenome, false, isCamelHal(alignment),
-                 onlySequenceNames);
+    sgbuild.setLazySequenceNames(true);
+    sgbuild.setNumThreads(numThreads, halPath, &optionsParser);
+    sgbuild.setVerifyLevel(verifyLevel);
+    sgbuild.setDNACacheSize((size_t)dnaCacheSize << 20);
+    sgbuild.setMaxPreloadBytes((size_t)preloadSize << 20);
+    sgbuild.setMaxSequenceDNABytes((size_t)seqDNASize << 20);
+    sgbuild.setMaxMemory((size_t)maxMemory << 20);
+    sgbuild.setGenomeOrder(breadthFirstOrdering);
     
     // add the genomes in the breadth first order
-    for (size_t i = 0; i < breadthFirstOrdering.size(); ++i)
+    if (parallelClades == true)
     {
-      sgbuild.addGenome(breadthFirstOrdering[i]);
+      sgbuild.addGenomesByClade(breadthFirstOrdering);
+    }
+    else
+    {
+      size_t numRestored = 0;
+      if (resume == true)
+      {
+        vector<const Genome*> restored = 
+           sgbuild.resumeCheckpoint(checkpointPath);
+        numRestored = restored.size();
+        for (size_t i = 0; i < numRestored; ++i)
+        {
+          if (i >= breadthFirstOrdering.size() ||
+              restored[i] != breadthFirstOrdering[i])
+          {
+            throw hal_exception("checkpoint " + checkpointPath + 
+                                " was made with different options");
+          }
+        }
+        cout << "Resuming after " << numRestored << " genomes from "
+             << checkpointPath << endl;
+      }
+      else if (noCheckpoint == false)
+      {
+        sgbuild.setCheckpointPath(checkpointPath);
+      }
+      for (size_t i = numRestored; i < breadthFirstOrdering.size(); ++i)
+      {
+        sgbuild.addGenome(breadthFirstOrdering[i]);
+      }
     }
 
     // compute all the joins in second pass (and do sanity check
-    // on every path in graph)
-    sgbuild.computeJoins(!noAncestors);
-    
-    //cout << *sgbuild.getSideGraph() << endl;
-
+    // on every path in graph), writing the paths out as we go
     HALSGSQL sqlWriter;
-    sqlWriter.exportGraph(&sgbuild, sqlPath, fastaPath, halPath,
-                          !noAncestors);
+    sqlWriter.computeJoinsAndExport(&sgbuild, sqlPath, fastaPath, halPath,
+                                    !noAncestors);
+    if (noCheckpoint == false)
+    {
+      sgbuild.setCheckpointPath("");
+      remove(checkpointPath.c_str());
+    }
+
+    if (preloadSize > 0)
+    {
+      cerr << "Preloaded DNA: " << sgbuild.getNumPreloadedGenomes() 
+           << " genomes in " << sgbuild.getPreloadBytes() << " bytes" << endl;
+    }
+    if (seqDNASize > 0)
+    {
+      cerr << "Side graph sequence DNA: " << sgbuild.getSequenceDNABytes()
+           << " bytes" << endl;
+    }
+    if (maxMemory > 0)
+    {
+      cerr << "Spilled lookups: " << sgbuild.getNumSpilledLookups() << endl;
+    }
+    if (dnaCacheSize > 0)
+    {
+      const DNACache& dnaCache = sgbuild.getDNACache();
+      cerr << "DNA cache: " << dnaCache.getNumHits() << " hits, "
+           << dnaCache.getNumMisses() << " misses (pages of "
+           << DNACache::PageSize << " bases)" << endl;
+    }
 
   }
 /*  catch(hal_exception& e)
@@ -247,30 +457,6 @@ int main(int argc, char** argv)
   return 0;
 }
 
-/** CAMEL writes the root's DNA sequence as N's.  This screws up SNP detection
- * in the conversion when the root is used as the first anchor.  So we run a
- * check here to see if the root's all N's, if it is we set the camel flag
- * in sgbuilder to tell it to infer the root from its children (possible as
- * there are no substitutions in CAMEL HAL files */
-bool isCamelHal(AlignmentConstPtr alignment)
-{
-  const Genome* rootGenome = alignment->openGenome(alignment->getRootName());
-  if (rootGenome->getSequenceLength() == 0)
-  {
-    return false;
-  }
-  DnaIteratorPtr dnaIt = rootGenome->getDnaIterator();
-  size_t length = rootGenome->getSequenceLength();
-  for (hal_size_t i = 0; i < length; ++i, dnaIt->toRight())
-  {
-    if (toupper(dnaIt->getBase()) != 'N')
-    {
-      return false;
-    }
-  }
-  return true;
-}
-
 void breadthFirstGenomeSearch(const Genome* reference,
                               const vector<const Genome*>& targets,
                               vector<const Genome*>& outTraversal)
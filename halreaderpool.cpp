@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <iostream>
+#include <cassert>
+#include <H5public.h>
+
+#include "halreaderpool.h"
+
+using namespace std;
+using namespace hal;
+
+HALReaderPool::HALReaderPool()
+{
+
+}
+
+HALReaderPool::~HALReaderPool()
+{
+  clear();
+}
+
+void HALReaderPool::init(AlignmentConstPtr alignment, size_t numReaders,
+                         const string& halPath, CLParser* options)
+{
+  clear();
+  numReaders = max(numReaders, (size_t)1);
+  if (numReaders > 1 && halPath.empty())
+  {
+    throw hal_exception("HAL path required to use more than one reader");
+  }
+#ifndef H5_HAVE_THREADSAFE
+  // separate handles don't make a non-threadsafe HDF5 reentrant
+  if (numReaders > 1)
+  {
+    cerr << "Warning: HDF5 library was not built with --enable-threadsafe. "
+         << "Using a single thread" << endl;
+    numReaders = 1;
+  }
+#endif
+  _alignments.push_back(alignment);
+  for (size_t i = 1; i < numReaders; ++i)
+  {
+    _alignments.push_back(AlignmentConstPtr(
+                            openHalAlignment(halPath, options,
+                                             hal::READ_ACCESS)));
+  }
+}
+
+void HALReaderPool::clear()
+{
+  _genomeMap.clear();
+  _alignments.clear();
+}
+
+void HALReaderPool::openGenome(const Genome* genome)
+{
+  assert(_alignments.empty() == false);
+  if (_genomeMap.find(genome->getName()) != _genomeMap.end())
+  {
+    return;
+  }
+  GenomeHandles& handles = _genomeMap[genome->getName()];
+  handles._genomes.resize(_alignments.size());
+  handles._sequences.resize(_alignments.size());
+  for (size_t i = 0; i < _alignments.size(); ++i)
+  {
+    const Genome* readerGenome = i == 0 ? genome :
+       _alignments[i]->openGenome(genome->getName());
+    handles._genomes[i] = readerGenome;
+    vector<const Sequence*>& sequences = handles._sequences[i];
+    sequences.resize(readerGenome->getNumSequences());
+    SequenceIteratorPtr si = readerGenome->getSequenceIterator();
+    for (size_t j = 0; j < sequences.size(); ++j, si->toNext())
+    {
+      sequences[si->getSequence()->getArrayIndex()] = si->getSequence();
+    }
+  }
+}
+
+const HALReaderPool::GenomeHandles& 
+HALReaderPool::getHandles(const Genome* genome) const
+{
+  GenomeMap::const_iterator i = _genomeMap.find(genome->getName());
+  if (i == _genomeMap.end())
+  {
+    throw hal_exception("Genome " + genome->getName() + 
+                        " not opened in HAL reader pool");
+  }
+  return i->second;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _HALREADERPOOL_H
+#define _HALREADERPOOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "hal.h"
+
+/*
+ * The HAL API (and the HDF5 library under it) can't be read from several
+ * threads through the same handle.  This class keeps one handle per 
+ * thread:  reader 0 is the alignment we were given and the others are
+ * opened separately from the same file.  Genomes and Sequences from 
+ * reader 0 can then be translated into the matching objects of any 
+ * other reader (and back) without touching the HAL API.
+ *
+ * openGenome() is the only method that modifies the pool, and must be
+ * called (from the main thread) while no other reader is in use.  All
+ * translations are read-only lookups.
+ */
+class HALReaderPool
+{
+public:
+
+   HALReaderPool();
+   ~HALReaderPool();
+
+   /** Use alignment as reader 0 and open numReaders - 1 more handles 
+    * from halPath (which is required if numReaders > 1).  If HDF5 isn't
+    * threadsafe, only reader 0 is used (see getNumReaders()) */
+   void init(hal::AlignmentConstPtr alignment, size_t numReaders, 
+             const std::string& halPath = "",
+             hal::CLParser* options = NULL);
+   void clear();
+
+   size_t getNumReaders() const;
+   hal::AlignmentConstPtr getAlignment(size_t reader) const;
+
+   /** Make a (reader 0) genome available to all readers */
+   void openGenome(const hal::Genome* genome);
+
+   /** Get the reader's handle for the given reader 0 genome */
+   const hal::Genome* getGenome(const hal::Genome* genome,
+                                size_t reader) const;
+
+   /** Get the reader's handle for the given reader 0 sequence */
+   const hal::Sequence* getSequence(const hal::Sequence* sequence,
+                                    size_t reader) const;
+
+   /** Get the reader 0 handle for any reader's sequence */
+   const hal::Sequence* getMainSequence(const hal::Sequence* sequence) const;
+
+protected:
+
+   // handles for one genome across all readers
+   struct GenomeHandles {
+      std::vector<const hal::Genome*> _genomes;
+      // by reader then by sequence array index
+      std::vector<std::vector<const hal::Sequence*> > _sequences;
+   };
+   typedef std::map<std::string, GenomeHandles> GenomeMap;
+
+   const GenomeHandles& getHandles(const hal::Genome* genome) const;
+
+protected:
+
+   std::vector<hal::AlignmentConstPtr> _alignments;
+   GenomeMap _genomeMap;
+};
+
+inline size_t HALReaderPool::getNumReaders() const
+{
+  return _alignments.size();
+}
+
+inline hal::AlignmentConstPtr HALReaderPool::getAlignment(size_t reader) const
+{
+  return _alignments[reader];
+}
+
+inline const hal::Genome* HALReaderPool::getGenome(const hal::Genome* genome,
+                                                   size_t reader) const
+{
+  return reader == 0 ? genome : getHandles(genome)._genomes[reader];
+}
+
+inline const hal::Sequence* 
+HALReaderPool::getSequence(const hal::Sequence* sequence, size_t reader) const
+{
+  return reader == 0 ? sequence : getHandles(
+    sequence->getGenome())._sequences[reader][sequence->getArrayIndex()];
+}
+
+inline const hal::Sequence* 
+HALReaderPool::getMainSequence(const hal::Sequence* sequence) const
+{
+  return getHandles(
+    sequence->getGenome())._sequences[0][sequence->getArrayIndex()];
+}
+
+#endif
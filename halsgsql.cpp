@@ -3,6 +3,7 @@
  *
  * Released under the MIT license, see LICENSE.txt
  */
+#include <sstream>
 #include "md5.h"
 #include "halsgsql.h"
 
@@ -15,9 +16,10 @@ HALSGSQL::HALSGSQL() : SGSQL(), _sgBuilder(0), _writeAncestralPaths(false)
 
 HALSGSQL::~HALSGSQL()
 {
+  closePathSpools();
 }
 
-void HALSGSQL::exportGraph(const SGBuilder* sgBuilder,
+void HALSGSQL::exportGraph(SGBuilder* sgBuilder,
                            const string& sqlInsertPath,
                            const string& fastaPath, const string& halPath,
                            bool writeAncestralPaths)
@@ -26,9 +28,80 @@ void HALSGSQL::exportGraph(const SGBuilder* sgBuilder,
   _halPath = halPath;
   _writeAncestralPaths = writeAncestralPaths;
 
+  sgBuilder->prefetchSequenceDNA();
+  sgBuilder->nameSequences();
   writeDb(sgBuilder->getSideGraph(), sqlInsertPath, fastaPath);
 }
 
+void HALSGSQL::computeJoinsAndExport(SGBuilder* sgBuilder,
+                                     const string& sqlInsertPath,
+                                     const string& fastaPath,
+                                     const string& halPath,
+                                     bool writeAncestralPaths)
+{
+  _sgBuilder = sgBuilder;
+  _writeAncestralPaths = writeAncestralPaths;
+  vector<const Sequence*> pathSequences;
+  getPathSequences(pathSequences);
+
+  closePathSpools();
+  for (size_t i = 0; i < sgBuilder->getNumThreads(); ++i)
+  {
+    FILE* spool = tmpfile();
+    if (spool == NULL)
+    {
+      closePathSpools();
+      throw hal_exception("error creating temporary file for paths");
+    }
+    _pathSpools.push_back(spool);
+  }
+  _pathSpoolEntries.resize(pathSequences.size());
+
+  try
+  {
+    // same sequences as getPathSequences(), so the indexes match
+    sgBuilder->computeJoins(writeAncestralPaths, this);
+    exportGraph(sgBuilder, sqlInsertPath, fastaPath, halPath, 
+                writeAncestralPaths);
+  }
+  catch (...)
+  {
+    closePathSpools();
+    throw;
+  }
+  closePathSpools();
+}
+
+void HALSGSQL::writePath(size_t index, size_t threadIdx,
+                         const Sequence* sequence,
+                         const vector<SGSegment>& path)
+{
+  assert(index < _pathSpoolEntries.size());
+  assert(threadIdx < _pathSpools.size());
+  stringstream ss;
+  writeAllelePathItems(ss, index, sequence, path);
+  string buffer = ss.str();
+  FILE* spool = _pathSpools[threadIdx];
+  PathSpoolEntry& entry = _pathSpoolEntries[index];
+  entry._spool = threadIdx;
+  entry._offset = ftell(spool);
+  entry._length = buffer.length();
+  if (fwrite(buffer.c_str(), 1, buffer.length(), spool) != buffer.length())
+  {
+    throw hal_exception("error writing paths to temporary file");
+  }
+}
+
+void HALSGSQL::closePathSpools()
+{
+  for (size_t i = 0; i < _pathSpools.size(); ++i)
+  {
+    fclose(_pathSpools[i]);
+  }
+  _pathSpools.clear();
+  _pathSpoolEntries.clear();
+}
+
 void HALSGSQL::getSequenceString(const SGSequence* seq,
                                  std::string& outString) const
 {
@@ -50,6 +123,45 @@ string HALSGSQL::getDescription() const
   return string("hal2sg ") + _halPath;
 }
 
+void HALSGSQL::getPathSequences(vector<const Sequence*>& outSequences) const
+{
+  outSequences = _sgBuilder->getHalSequences();
+
+  // filter out ancestral genomes if not wanted
+  if (_writeAncestralPaths == false)
+  {
+    vector<const Sequence*> leafSequences;
+    for (size_t i = 0; i < outSequences.size(); ++i)
+    {
+      if (outSequences[i]->getGenome()->getNumChildren() == 0)
+      {
+        leafSequences.push_back(outSequences[i]);
+      }
+    }
+    swap(outSequences, leafSequences);
+  }
+}
+
+void HALSGSQL::writeAllelePathItems(ostream& os, size_t alleleID,
+                                    const Sequence* sequence,
+                                    const vector<SGSegment>& path) const
+{
+  os << "-- PATH for HAL input sequence "
+     << _sgBuilder->getHalSeqName(sequence) << "\n";
+  for (size_t j = 0; j < path.size(); ++j)
+  {
+    os << "INSERT INTO AllelePathItem VALUES ("
+       << alleleID << ", "
+       << j << ", "
+       << path[j].getSide().getBase().getSeqID() << ", "
+       << path[j].getSide().getBase().getPos() << ", "
+       << path[j].getLength() << ", "
+       << (path[j].getSide().getForward() ? "\'TRUE\'" : "\'FALSE\'")
+       << ");\n";
+  }
+  os << "\n";
+}
+
 /*
 CREATE TABLE VariantSet (ID INTEGER PRIMARY KEY,
 	referenceSetID INTEGER NOT NULL REFERENCES ReferenceSet(ID),
@@ -76,23 +188,10 @@ void HALSGSQL::writePathInserts()
   // TODO: refactor so that formatting logic gets de-coupled from hal
   // and sgbuilder and moved to sgExport/sgsql.cpp...
 
-  vector<const Sequence*> halSequences = _sgBuilder->getHalSequences();
+  vector<const Sequence*> halSequences;
+  getPathSequences(halSequences);
   map<const Genome*, size_t> genomeIdMap;
 
-  // filter out ancestral genomes if not wanted
-  if (_writeAncestralPaths == false)
-  {
-    vector<const Sequence*> leafSequences;
-    for (size_t i = 0; i < halSequences.size(); ++i)
-    {
-      if (halSequences[i]->getGenome()->getNumChildren() == 0)
-      {
-        leafSequences.push_back(halSequences[i]);
-      }
-    }
-    swap(halSequences, leafSequences);
-  }
-
   // create a variant set for every genome
   for (size_t i = 0; i < halSequences.size(); ++i)
   {
@@ -122,30 +221,37 @@ void HALSGSQL::writePathInserts()
   _outStream << endl;
 
   // create a path (AellePathItem) for every sequence
+  if (_pathSpools.empty() == false)
+  {
+    // already done by computeJoinsAndExport(), just need to copy them
+    assert(_pathSpoolEntries.size() == halSequences.size());
+    vector<char> buffer(1 << 16);
+    for (size_t i = 0; i < _pathSpoolEntries.size(); ++i)
+    {
+      const PathSpoolEntry& entry = _pathSpoolEntries[i];
+      FILE* spool = _pathSpools[entry._spool];
+      if (fseek(spool, entry._offset, SEEK_SET) != 0)
+      {
+        throw hal_exception("error reading paths from temporary file");
+      }
+      for (size_t left = entry._length; left > 0;)
+      {
+        size_t chunk = min(left, buffer.size());
+        if (fread(&buffer[0], 1, chunk, spool) != chunk)
+        {
+          throw hal_exception("error reading paths from temporary file");
+        }
+        _outStream.write(&buffer[0], chunk);
+        left -= chunk;
+      }
+    }
+    return;
+  }
+  
   for (size_t i = 0; i < halSequences.size(); ++i)
   {
-    _outStream << "-- PATH for HAL input sequence "
-               << _sgBuilder->getHalSeqName(halSequences[i]) << "\n";
     vector<SGSegment> path;
-
-    // note we're calling this a second time here.  if this is costly
-    // we can cache the paths or compute the joins once on the fly here
-    // (because this was done a first time in computeJoins())
     _sgBuilder->getHalSequencePath(halSequences[i], path);
-    for (size_t j = 0; j < path.size(); ++j)
-    {
-      _outStream << "INSERT INTO AllelePathItem VALUES ("
-                 << i << ", "
-                 << j << ", "
-                 << path[j].getSide().getBase().getSeqID() << ", "
-                 << path[j].getSide().getBase().getPos() << ", "
-                 << path[j].getLength() << ", "
-                 << (path[j].getSide().getForward() ? "\'TRUE\'" : "\'FALSE\'")
-                 << ");\n";
-      
-    }
-    _outStream <<endl;
+    writeAllelePathItems(_outStream, i, halSequences[i], path);
   }
-
 }
-
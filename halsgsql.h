@@ -14,6 +14,7 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdio>
 
 #include "sgsql.h"
 #include "sgbuilder.h"
@@ -26,7 +27,7 @@
  * specific logic coming from SGBuilder...
  */
 
-class HALSGSQL : public SGSQL
+class HALSGSQL : public SGSQL, public SGBuilder::PathSink
 {
 public:
    HALSGSQL();
@@ -34,12 +35,45 @@ public:
 
    /** write out the graph as a database 
     */
-   void exportGraph(const SGBuilder* sgBuilder,
+   void exportGraph(SGBuilder* sgBuilder,
                     const std::string& sqlInsertPath,
                     const std::string& fastaPath, const std::string& halPath,
                     bool writeAncestralPaths = true);
+
+   /** compute the joins (sgBuilder->computeJoins()) then write out the 
+    * graph as a database.  the paths are spooled to temporary files
+    * as the joins are computed, instead of being looked up a second time 
+    * for the export.  the builder's lookups are freed along the way.
+    */
+   void computeJoinsAndExport(SGBuilder* sgBuilder,
+                              const std::string& sqlInsertPath,
+                              const std::string& fastaPath,
+                              const std::string& halPath,
+                              bool writeAncestralPaths = true);
+
+   /** spool the AllelePathItem INSERTs of a path (called by 
+    * SGBuilder::computeJoins())
+    */
+   void writePath(size_t index, size_t threadIdx,
+                  const hal::Sequence* sequence,
+                  const std::vector<SGSegment>& path);
 protected:
 
+   /** get the sequences to write paths for, in order
+    */
+   void getPathSequences(std::vector<const hal::Sequence*>& outSequences) 
+     const;
+
+   /** write the INSERTs for one path 
+    */
+   void writeAllelePathItems(std::ostream& os, size_t alleleID,
+                             const hal::Sequence* sequence,
+                             const std::vector<SGSegment>& path) const;
+
+   /** close and forget the spool files 
+    */
+   void closePathSpools();
+
 
    /** write path INSERTs (makes a VariantSet for each Genome and 
     * an Allele for each sequence
@@ -68,6 +102,17 @@ protected:
 
    const SGBuilder* _sgBuilder;
    bool _writeAncestralPaths;
+
+   // where the paths written by computeJoins() are, by allele ID 
+   struct PathSpoolEntry
+   {
+      size_t _spool;
+      long _offset;
+      size_t _length;
+   };
+   // one temporary file for each thread
+   std::vector<FILE*> _pathSpools;
+   std::vector<PathSpoolEntry> _pathSpoolEntries;
 };
 
 
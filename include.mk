@@ -15,7 +15,18 @@ sgExportPath=${rootPath}/sgExport
 include  ${sonLibRootPath}/include.mk
 
 cflags += -I ${sonLibPath}  -I ${halIncPath} -I ${halLIIncPath} -I ${sgExportPath}
-cppflags += -I ${sonLibPath}  -I ${halIncPath} -I ${halLIIncPath} -I ${sgExportPath} -UNDEBUG
+cppflags += -I ${sonLibPath}  -I ${halIncPath} -I ${halLIIncPath} -I ${sgExportPath} -UNDEBUG -pthread
+# build the DNA kernels (dnakernel.cpp) for a newer x86 instruction set
+# with SIMD=avx2 or SIMD=ssse3 (default is SSE2, which every x86-64 has).
+# The binary then only runs on CPUs that support it.
+ifeq (${SIMD},avx2)
+	cppflags += -mavx2
+else ifeq (${SIMD},ssse3)
+	cppflags += -mssse3
+else ifneq (${SIMD},)
+$(error SIMD must be avx2 or ssse3)
+endif
+
 basicLibs = ${halPath}/libHalLiftover.a ${halPath}/libHal.a ${sonLibPath}/sonLib.a ${sonLibPath}/cuTest.a ${sgExportPath}/sgExport.a 
 basicLibsDependencies = ${basicLibs}
 
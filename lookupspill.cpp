@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <cassert>
+
+#include "hal.h"
+#include "lookupspill.h"
+
+using namespace std;
+using namespace hal;
+
+// HAL sequence, HAL position, side graph sequence, side graph position
+// and length (negative if reversed)
+static const size_t RecordSize = 5;
+
+LookupSpill::LookupSpill() : _file(NULL), _numIntervals(0)
+{
+}
+
+LookupSpill::~LookupSpill()
+{
+  if (_file != NULL)
+  {
+    fclose(_file);
+  }
+}
+
+void LookupSpill::init(const vector<string>& seqNames)
+{
+  if (_file != NULL)
+  {
+    fclose(_file);
+  }
+  _seqNames = seqNames;
+  _numIntervals = 0;
+  _file = tmpfile();
+  if (_file == NULL)
+  {
+    throw hal_exception("error creating temporary file for lookup");
+  }
+}
+
+void LookupSpill::addPath(sg_int_t halSeqID, const vector<SGSegment>& path)
+{
+  assert(_file != NULL);
+  sg_int_t halPos = 0;
+  for (size_t i = 0; i < path.size(); ++i)
+  {
+    const SGSegment& seg = path[i];
+    SGPosition minPos = seg.getMinPos();
+    sg_int_t record[RecordSize] = {halSeqID, halPos, 
+                                   minPos.getSeqID(), minPos.getPos(),
+                                   seg.getSide().getForward() ? 
+                                   seg.getLength() : -seg.getLength()};
+    if (fwrite(record, sizeof(sg_int_t), RecordSize, _file) != RecordSize)
+    {
+      throw hal_exception("error writing lookup to temporary file");
+    }
+    halPos += seg.getLength();
+  }
+  _numIntervals += path.size();
+}
+
+SGLookup* LookupSpill::load()
+{
+  assert(_file != NULL);
+  SGLookup* lookup = new SGLookup();
+  lookup->init(_seqNames);
+  rewind(_file);
+  sg_int_t record[RecordSize];
+  for (size_t i = 0; i < _numIntervals; ++i)
+  {
+    if (fread(record, sizeof(sg_int_t), RecordSize, _file) != RecordSize)
+    {
+      delete lookup;
+      throw hal_exception("error reading lookup from temporary file");
+    }
+    lookup->addInterval(SGPosition(record[0], record[1]),
+                        SGPosition(record[2], record[3]),
+                        record[4] < 0 ? -record[4] : record[4],
+                        record[4] < 0);
+  }
+  // in case more paths get added
+  fseek(_file, 0, SEEK_END);
+  return lookup;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _LOOKUPSPILL_H
+#define _LOOKUPSPILL_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "sglookup.h"
+
+/*
+ * Copy of a finished SGLookup in a temporary file, so that the lookup
+ * can be deleted while it's not needed and rebuilt when it is.  SGLookup
+ * can't be written out itself, so it's saved as the paths of its HAL
+ * sequences instead (which is all that's needed to rebuild it, as done
+ * when merging clades).  Each path segment is written as a fixed size
+ * binary record of 40 bytes.
+ */
+class LookupSpill
+{
+public:
+
+   LookupSpill();
+   ~LookupSpill();
+
+   /** Start a new file for a lookup made with SGLookup::init(seqNames) */
+   void init(const std::vector<std::string>& seqNames);
+   
+   /** Add the path of the HAL sequence with (array index) halSeqID */
+   void addPath(sg_int_t halSeqID, const std::vector<SGSegment>& path);
+
+   /** Number of path segments, ie intervals in the rebuilt lookup */
+   size_t getNumIntervals() const;
+
+   /** Make a new SGLookup from the file */
+   SGLookup* load();
+
+protected:
+
+   std::vector<std::string> _seqNames;
+   FILE* _file;
+   size_t _numIntervals;
+
+private:
+   LookupSpill(const LookupSpill&);
+   LookupSpill& operator=(const LookupSpill&);
+};
+
+inline size_t LookupSpill::getNumIntervals() const
+{
+  return _numIntervals;
+}
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <cassert>
+#include <cctype>
+#include <algorithm>
+
+#include "packeddna.h"
+
+using namespace std;
+
+// A C G T -> 0 1 2 3,  anything else -> 4
+static const unsigned char* getCodeTable()
+{
+  static unsigned char table[256];
+  static bool init = false;
+  if (init == false)
+  {
+    for (size_t i = 0; i < 256; ++i)
+    {
+      table[i] = 4;
+    }
+    table['A'] = table['a'] = 0;
+    table['C'] = table['c'] = 1;
+    table['G'] = table['g'] = 2;
+    table['T'] = table['t'] = 3;
+    init = true;
+  }
+  return table;
+}
+// fill in the table before there's any chance of threads
+static const unsigned char* codeTable = getCodeTable();
+
+static const char decodeTable[4] = {'A', 'C', 'G', 'T'};
+
+PackedDNA::PackedDNA() : _length(0)
+{
+
+}
+
+PackedDNA::~PackedDNA()
+{
+
+}
+
+void PackedDNA::clear()
+{
+  _length = 0;
+  _bases.clear();
+  _softMask.clear();
+  _exceptions.clear();
+}
+
+size_t PackedDNA::getNumBytes(size_t length)
+{
+  return ((length + 31) / 32 + (length + 63) / 64) * sizeof(uint64_t);
+}
+
+size_t PackedDNA::getNumBytes() const
+{
+  return getNumBytes(_length) + _exceptions.size() * sizeof(Exception);
+}
+
+void PackedDNA::append(const char* dna, size_t length)
+{
+  _bases.resize((_length + length + 31) / 32, 0);
+  _softMask.resize((_length + length + 63) / 64, 0);
+  for (size_t i = 0; i < length; ++i, ++_length)
+  {
+    unsigned char c = dna[i];
+    uint64_t code = codeTable[c];
+    if (code == 4)
+    {
+      char base = toupper(c);
+      if (_exceptions.empty() == false && 
+          _exceptions.back()._base == base &&
+          _exceptions.back()._start + _exceptions.back()._length == _length)
+      {
+        ++_exceptions.back()._length;
+      }
+      else
+      {
+        Exception exception;
+        exception._start = _length;
+        exception._length = 1;
+        exception._base = base;
+        _exceptions.push_back(exception);
+      }
+      code = 0;
+    }
+    _bases[_length / 32] |= code << (2 * (_length % 32));
+    if (islower(c))
+    {
+      _softMask[_length / 64] |= (uint64_t)1 << (_length % 64);
+    }
+  }
+}
+
+void PackedDNA::getSubString(string& outDNA, size_t pos, size_t length) const
+{
+  assert(pos + length <= _length);
+  outDNA.resize(length);
+  for (size_t i = 0; i < length; ++i)
+  {
+    size_t j = pos + i;
+    outDNA[i] = decodeTable[(_bases[j / 32] >> (2 * (j % 32))) & 3];
+  }
+
+  // overwrite with exceptions, from the first run that ends after pos
+  size_t lo = 0;
+  size_t hi = _exceptions.size();
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (_exceptions[mid]._start + _exceptions[mid]._length <= pos)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  for (size_t e = lo; e < _exceptions.size() && 
+          _exceptions[e]._start < pos + length; ++e)
+  {
+    size_t start = max(_exceptions[e]._start, pos);
+    size_t end = min(_exceptions[e]._start + _exceptions[e]._length, 
+                     pos + length);
+    fill(outDNA.begin() + (start - pos), outDNA.begin() + (end - pos),
+         _exceptions[e]._base);
+  }
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    size_t j = pos + i;
+    if ((_softMask[j / 64] >> (j % 64)) & 1)
+    {
+      outDNA[i] = tolower(outDNA[i]);
+    }
+  }
+}
+
+PackedDNAStore::PackedDNAStore() : _numBytes(0), _maxBytes(0)
+{
+
+}
+
+PackedDNAStore::~PackedDNAStore()
+{
+
+}
+
+void PackedDNAStore::clear()
+{
+  _dna.clear();
+  _numBytes = 0;
+}
+
+void PackedDNAStore::setMaxBytes(size_t maxBytes)
+{
+  _maxBytes = maxBytes;
+}
+
+PackedDNA* PackedDNAStore::reserve(size_t id, size_t numBytes)
+{
+  if (id < _dna.size())
+  {
+    _numBytes -= _dna[id].getNumBytes();
+    // (free the memory too)
+    _dna[id] = PackedDNA();
+  }
+  if (_numBytes + numBytes > _maxBytes)
+  {
+    return NULL;
+  }
+  if (id >= _dna.size())
+  {
+    _dna.resize(id + 1);
+  }
+  return &_dna[id];
+}
+
+bool PackedDNAStore::add(size_t id, const char* dna, size_t length)
+{
+  PackedDNA* packedDNA = reserve(id, PackedDNA::getNumBytes(length));
+  if (packedDNA == NULL)
+  {
+    return false;
+  }
+  packedDNA->append(dna, length);
+  // exceptions weren't counted by reserve()
+  if (_numBytes + packedDNA->getNumBytes() > _maxBytes)
+  {
+    *packedDNA = PackedDNA();
+    return false;
+  }
+  _numBytes += packedDNA->getNumBytes();
+  return true;
+}
+
+bool PackedDNAStore::add(size_t id, const PackedDNA& dna)
+{
+  PackedDNA* packedDNA = reserve(id, dna.getNumBytes());
+  if (packedDNA == NULL)
+  {
+    return false;
+  }
+  *packedDNA = dna;
+  _numBytes += packedDNA->getNumBytes();
+  return true;
+}
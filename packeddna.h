@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _PACKEDDNA_H
+#define _PACKEDDNA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+
+/*
+ * DNA string packed into 2 bits per base.  Anything other than ACGT
+ * (ie N and the other IUPAC codes) is kept in a list of runs of the 
+ * same character, and a bitmap remembers which bases were lower case
+ * (soft-masked), so the exact input string can be read back.
+ * About 3/8 of a byte per base for typical genomes.
+ */
+class PackedDNA
+{
+public:
+
+   PackedDNA();
+   ~PackedDNA();
+
+   void clear();
+   size_t getLength() const;
+   /** Approximate memory used */
+   size_t getNumBytes() const;
+   
+   /** Add length bases to the end */
+   void append(const char* dna, size_t length);
+   void append(const std::string& dna);
+
+   /** Get length bases starting at pos */
+   void getSubString(std::string& outDNA, size_t pos, size_t length) const;
+
+   /** Bytes needed to store length bases (not counting exceptions) */
+   static size_t getNumBytes(size_t length);
+
+protected:
+
+   // run of (identical) non-ACGT characters
+   struct Exception
+   {
+      size_t _start;
+      size_t _length;
+      char _base;
+   };
+   
+   size_t _length;
+   // 32 bases per word, first base in the lowest bits
+   std::vector<uint64_t> _bases;
+   // 64 bases per word, set if lower case
+   std::vector<uint64_t> _softMask;
+   // in order
+   std::vector<Exception> _exceptions;
+};
+
+/** Packed DNA of each Side Graph sequence, by sequence ID (a deque, so
+ * adding sequences never copies the ones already there).  DNA is only 
+ * added while it fits in maxBytes, so the store is empty (off) until
+ * setMaxBytes() is called. */
+class PackedDNAStore
+{
+public:
+
+   PackedDNAStore();
+   ~PackedDNAStore();
+
+   void clear();
+   void setMaxBytes(size_t maxBytes);
+   size_t getMaxBytes() const;
+   /** Approximate memory used */
+   size_t getNumBytes() const;
+
+   /** Store the DNA of sequence id, replacing what's there.  Returns
+    * false, leaving nothing for id, if it doesn't fit in maxBytes */
+   bool add(size_t id, const char* dna, size_t length);
+   bool add(size_t id, const std::string& dna);
+   bool add(size_t id, const PackedDNA& dna);
+
+   /** Get the DNA of id if all length bases of it are stored, otherwise
+    * NULL */
+   const PackedDNA* get(size_t id, size_t length) const;
+
+protected:
+
+   /** Make id's entry, if it can hold numBytes, and return it */
+   PackedDNA* reserve(size_t id, size_t numBytes);
+
+   std::deque<PackedDNA> _dna;
+   size_t _numBytes;
+   size_t _maxBytes;
+};
+
+inline size_t PackedDNA::getLength() const
+{
+  return _length;
+}
+
+inline void PackedDNA::append(const std::string& dna)
+{
+  append(dna.c_str(), dna.length());
+}
+
+inline size_t PackedDNAStore::getMaxBytes() const
+{
+  return _maxBytes;
+}
+
+inline size_t PackedDNAStore::getNumBytes() const
+{
+  return _numBytes;
+}
+
+inline bool PackedDNAStore::add(size_t id, const std::string& dna)
+{
+  return add(id, dna.c_str(), dna.length());
+}
+
+inline const PackedDNA* PackedDNAStore::get(size_t id, size_t length) const
+{
+  return id < _dna.size() && _dna[id].getLength() == length ? &_dna[id] :
+     NULL;
+}
+
+#endif
@@ -5,19 +5,44 @@
  */
 
 #include <sstream>
+#include <algorithm>
+#include <functional>
+#include <sys/time.h>
 
 #include "sgbuilder.h"
 #include "snphandler.h"
 #include "halBlockMapper.h"
+#include "dnakernel.h"
 
 using namespace std;
 using namespace hal;
 
+const sg_int_t SGBuilder::VerifyChunkSize = 1 << 16;
+const sg_int_t SGBuilder::VerifySampleRate = 64;
+const size_t SGBuilder::DefaultDNACacheSize = 256 << 20;
+const hal_index_t SGBuilder::PreloadChunkSize = 1 << 20;
+const sg_int_t SGBuilder::PrefetchMaxLength = 1 << 10;
+const hal_index_t SGBuilder::PrefetchWindowSize = 1 << 16;
+const hal_index_t SGBuilder::CamelCheckChunkSize = 1 << 20;
+const size_t SGBuilder::LookupIntervalBytes = 96;
+
 SGBuilder::SGBuilder() : _sg(0), _root(0), _mapRoot(0), _lookup(0), _mapMrca(0),
-                         _referenceDupes(true), _camelMode(false),
+                         _referenceDupes(true),
+                         _rootDNACache(DefaultDNACacheSize),
+                         _camelMode(false),
+                         _camelChecked(false),
+                         _camelCheckSeconds(0),
+                         _numFirstGenomeSequences(0),
                          _snpHandler(0),
                          _onlySequenceNames(false),
-                         _stripSequenceNames(false)
+                         _stripSequenceNames(false),
+                         _lazySequenceNames(false),
+                         _verifyLevel(VerifyFull),
+                         _dnaCache(DefaultDNACacheSize),
+                         _maxPreloadBytes(0),
+                         _preloadBytes(0),
+                         _maxMemory(0),
+                         _numSpilledLookups(0)
 {
 
 }
@@ -33,14 +58,19 @@ void SGBuilder::init(AlignmentConstPtr alignment, const Genome* root,
 {
   clear();
   _alignment = alignment;
+  _readerPool.init(alignment, 1);
+  _treeIndex.init(alignment->openGenome(alignment->getRootName()));
   _sg = new SideGraph();
   _root = root;
   _mapRoot = root;
   _referenceDupes = referenceDupes;
   _camelMode = camelMode;
   _snpHandler = new SNPHandler(_sg, false, onlySequenceNames);
+  _snpHandler->setDNAStore(&_sgDNA);
+  _snpHandler->setStripNames(stripSequenceNames);
   _onlySequenceNames = onlySequenceNames;
   _stripSequenceNames = stripSequenceNames;
+  _seqNames.setOnlySequenceNames(onlySequenceNames);
   _refPathSequences.clear();
 }
 
@@ -55,14 +85,187 @@ void SGBuilder::clear()
   }
   _luMap.clear();
   _lookup = NULL;
+  for (LookupSpillMap::iterator i = _lookupSpills.begin(); 
+       i != _lookupSpills.end(); ++i)
+  {
+    delete i->second;
+  }
+  _lookupSpills.clear();
+  _numSpilledLookups = 0;
+  _plannedTargets.clear();
+  _pendingTargetUses.clear();
+  _checkpoint.close();
   _lookBack.clear();
   _mapPath.clear();
   _mapMrca = NULL;
   _firstGenomeName.erase();
+  _numFirstGenomeSequences = 0;
   _halSequences.clear();
   delete _snpHandler;
   _snpHandler = NULL;
   _refPathSequences.clear();
+  _readerPool.clear();
+  _readerMapPaths.clear();
+  _treeIndex.clear();
+  _verifyLevel = VerifyFull;
+  _snpSequences.clear();
+  _rootDNACache.clear();
+  _dnaCache.clear();
+  _packedGenomes.clear();
+  _preloadBytes = 0;
+  _sgDNA.clear();
+  _threadPool.setNumThreads(1);
+  _mergeSeqMap.clear();
+  _lazySequenceNames = false;
+  _seqNames.clear();
+  _camelChecked = false;
+  _camelCheckSeconds = 0;
+}
+
+void SGBuilder::setNumThreads(size_t numThreads, const string& halPath,
+                              CLParser* options)
+{
+  assert(_alignment.get() != NULL);
+  numThreads = max(numThreads, (size_t)1);
+  if (numThreads > 1 && halPath.empty())
+  {
+    throw hal_exception("HAL path required to use more than one thread");
+  }
+  _readerPool.init(_alignment, numThreads, halPath, options);
+  _readerMapPaths.clear();
+  // every thread needs its own reader
+  _threadPool.setNumThreads(_readerPool.getNumReaders());
+}
+
+bool SGBuilder::detectCamelMode()
+{
+  assert(_alignment.get() != NULL);
+  if (_camelChecked == false)
+  {
+    // wall clock, since the check is mostly waiting on HAL reads
+    timeval start;
+    timeval end;
+    gettimeofday(&start, NULL);
+    _camelMode = isCamelGenome(_alignment->openGenome(
+                                 _alignment->getRootName()));
+    gettimeofday(&end, NULL);
+    _camelCheckSeconds = (double)(end.tv_sec - start.tv_sec) + 
+       (double)(end.tv_usec - start.tv_usec) / 1000000.;
+    _camelChecked = true;
+  }
+  return _camelMode;
+}
+
+bool SGBuilder::isCamelGenome(const Genome* genome)
+{
+  hal_index_t length = genome->getSequenceLength();
+  if (length == 0)
+  {
+    return false;
+  }
+  string buffer;
+  for (hal_index_t pos = 0; pos < length; pos += CamelCheckChunkSize)
+  {
+    genome->getSubString(buffer, pos, min(CamelCheckChunkSize, 
+                                          length - pos));
+    if (isAllN(buffer.data(), buffer.length()) == false)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SGBuilder::setLazySequenceNames(bool lazy)
+{
+  assert(_snpHandler != NULL);
+  _lazySequenceNames = lazy;
+  _snpHandler->setSeqNames(lazy ? &_seqNames : NULL);
+}
+
+void SGBuilder::nameSequences()
+{
+  string name;
+  for (sg_int_t i = 0; i < _sg->getNumSequences(); ++i)
+  {
+    if (_seqNames.hasOrigin(i))
+    {
+      _seqNames.getName(i, name);
+      // the side graph only hands out const sequences, but nothing in
+      // it depends on the name
+      const_cast<SGSequence*>(_sg->getSequence(i))->setName(name);
+    }
+  }
+  _seqNames.clear();
+}
+
+void SGBuilder::setCheckpointPath(const string& path)
+{
+  _checkpoint.close();
+  if (path.empty() == false)
+  {
+    _checkpoint.create(path);
+  }
+}
+
+vector<const Genome*> SGBuilder::resumeCheckpoint(const string& path)
+{
+  assert(_luMap.empty());
+  vector<const Genome*> genomes;
+  _checkpoint.resume(path);
+  string record;
+  while (_checkpoint.readRecord(record) == true)
+  {
+    genomes.push_back(restoreCheckpoint(record));
+  }
+  return genomes;
+}
+
+void SGBuilder::setVerifyLevel(VerifyLevel verifyLevel)
+{
+  _verifyLevel = verifyLevel;
+}
+
+void SGBuilder::setDNACacheSize(size_t maxBytes)
+{
+  _dnaCache.setMaxBytes(maxBytes);
+  _rootDNACache.setMaxBytes(maxBytes);
+}
+
+void SGBuilder::setMaxPreloadBytes(size_t maxBytes)
+{
+  _maxPreloadBytes = maxBytes;
+}
+
+void SGBuilder::setMaxSequenceDNABytes(size_t maxBytes)
+{
+  _sgDNA.setMaxBytes(maxBytes);
+}
+
+void SGBuilder::setMaxMemory(size_t maxBytes)
+{
+  assert(_luMap.empty());
+  _maxMemory = maxBytes;
+}
+
+void SGBuilder::setGenomeOrder(const vector<const Genome*>& genomes)
+{
+  // replay getTarget() on a fresh index
+  _plannedTargets.clear();
+  _pendingTargetUses.clear();
+  GenomeTreeIndex treeIndex;
+  treeIndex.init(_alignment->openGenome(_alignment->getRootName()));
+  for (size_t i = 0; i < genomes.size(); ++i)
+  {
+    _pendingTargetUses.insert(pair<string, size_t>(genomes[i]->getName(), 0));
+    const Genome* target = treeIndex.getNearestMarked(genomes[i]);
+    if (target != NULL)
+    {
+      _plannedTargets[genomes[i]->getName()] = target->getName();
+      ++_pendingTargetUses[target->getName()];
+    }
+    treeIndex.mark(genomes[i]);
+  }
 }
 
 SideGraph* SGBuilder::clear_except_sg()
@@ -82,6 +285,34 @@ size_t SGBuilder::getSequenceString(const SGSequence* sgSequence,
                                     string& outString,
                                     sg_int_t pos,
                                     sg_int_t length) const
+{
+  return getSequenceString(sgSequence, outString, pos, length, 0);
+}
+
+size_t SGBuilder::getSequenceString(const SGSequence* sgSequence,
+                                    string& outString,
+                                    sg_int_t pos,
+                                    sg_int_t length,
+                                    size_t reader) const
+{
+  sg_int_t seqID = sgSequence->getID();
+  const PackedDNA* packedDNA = _sgDNA.get(seqID, sgSequence->getLength());
+  if (packedDNA != NULL)
+  {
+    hal_index_t len = length == -1 ? sgSequence->getLength() : length;
+    assert(pos >= 0 && pos + len <= sgSequence->getLength());
+    packedDNA->getSubString(outString, pos, len);
+    return outString.length();
+  }
+  return getLookBackSequenceString(sgSequence, outString, pos, length, 
+                                   reader);
+}
+
+size_t SGBuilder::getLookBackSequenceString(const SGSequence* sgSequence,
+                                            string& outString,
+                                            sg_int_t pos,
+                                            sg_int_t length,
+                                            size_t reader) const
 {
   outString.clear();
   hal_index_t len = length == -1 ? sgSequence->getLength() : length;
@@ -101,15 +332,15 @@ size_t SGBuilder::getSequenceString(const SGSequence* sgSequence,
     if (_camelMode == true && halSeq->getGenome()->getParent() == NULL)
     {
       // adams root has not sequence. we infer it from children as a hack.
-      getRootSubString(buffer, halSeq, leftCoord, seg.getLength());
+      getRootSubString(buffer, halSeq, leftCoord, seg.getLength(), reader);
     }
     else
     {
-      halSeq->getSubString(buffer, leftCoord, seg.getLength());
+      readDNA(halSeq, leftCoord, seg.getLength(), buffer, reader);
     }
     if (seg.getSide().getForward() == false)
     {
-      reverseComplement(buffer);
+      reverseComplementDNA(buffer);
     }
     outString += buffer;
   }
@@ -137,11 +368,203 @@ void SGBuilder::getHalSequencePath(const Sequence* halSeq,
 {
   GenomeLUMap::const_iterator lui = _luMap.find(halSeq->getGenome()->getName());
   assert(lui != _luMap.end());
+  if (lui->second == NULL)
+  {
+    throw hal_exception("Lookup for genome " + halSeq->getGenome()->getName()
+                        + " already freed by computeJoins() (or spilled)");
+  }
   SGPosition start(halSeq->getArrayIndex(), 0);
   int len = max((hal_size_t)1, halSeq->getSequenceLength());
   lui->second->getPath(start, len, true, outPath);
 }
 
+/** Read ahead for addGenome().  The extra threads compute the blocks
+ * of each sequence, then read their DNA, each using the HAL handle
+ * belonging to the thread.  Meanwhile the calling thread consumes the
+ * jobs in order and adds them to the graph as soon as their data is 
+ * ready.  At most a window of (2 x threads) jobs are held in memory 
+ * at once.
+ */
+class SGBuilder::MapPipeline : public SGThreadPool::Task
+{
+public:
+   MapPipeline(SGBuilder* builder, vector<SequenceJob>& jobs,
+               const Genome* target) :
+     _builder(builder), _jobs(jobs), _target(target), _numFinished(0),
+     _aborted(false), _failed(false)
+   {
+     _window = 2 * _builder->_threadPool.getNumThreads();
+     pthread_mutex_init(&_mutex, NULL);
+     pthread_cond_init(&_cond, NULL);
+   }
+
+   ~MapPipeline()
+   {
+     pthread_cond_destroy(&_cond);
+     pthread_mutex_destroy(&_mutex);
+   }
+
+   void start()
+   {
+     _builder->_threadPool.start(_jobs.size(), this);
+   }
+
+   /** Stop the extra threads, skipping any jobs not yet started.  
+    * Throws the first error from any thread (but only once) */
+   void stop()
+   {
+     pthread_mutex_lock(&_mutex);
+     bool stopped = _aborted;
+     _aborted = true;
+     pthread_cond_broadcast(&_cond);
+     pthread_mutex_unlock(&_mutex);
+     if (stopped == false)
+     {
+       _builder->_threadPool.wait();
+     }
+   }
+
+   void run(size_t index, size_t threadIdx)
+   {
+     assert(threadIdx > 0);
+     pthread_mutex_lock(&_mutex);
+     while (_aborted == false && index >= _numFinished + _window)
+     {
+       pthread_cond_wait(&_cond, &_mutex);
+     }
+     bool aborted = _aborted;
+     pthread_mutex_unlock(&_mutex);
+     if (aborted == true)
+     {
+       return;
+     }
+
+     try
+     {
+       readJob(_jobs[index], threadIdx);
+     }
+     catch(...)
+     {
+       pthread_mutex_lock(&_mutex);
+       _failed = true;
+       pthread_cond_broadcast(&_cond);
+       pthread_mutex_unlock(&_mutex);
+       throw;
+     }
+   }
+
+   /** Wait for the blocks of a job to be computed */
+   void waitForBlocks(const SequenceJob& job)
+   {
+     pthread_mutex_lock(&_mutex);
+     while (_failed == false && job._blocksReady == false)
+     {
+       pthread_cond_wait(&_cond, &_mutex);
+     }
+     bool failed = _failed;
+     pthread_mutex_unlock(&_mutex);
+     if (failed == true)
+     {
+       // real error message comes from the thread pool
+       stop();
+       throw hal_exception("read ahead thread failed");
+     }
+   }
+
+   /** Wait for the DNA of a job's ith block to be read */
+   void waitForDNA(const SequenceJob& job, size_t i)
+   {
+     pthread_mutex_lock(&_mutex);
+     while (_failed == false && job._dnaReady <= i)
+     {
+       pthread_cond_wait(&_cond, &_mutex);
+     }
+     bool failed = _failed;
+     pthread_mutex_unlock(&_mutex);
+     if (failed == true)
+     {
+       stop();
+       throw hal_exception("read ahead thread failed");
+     }
+   }
+
+   /** Free a job's data once it's been added to the graph, making room 
+    * in the window */
+   void finish(SequenceJob& job)
+   {
+     delete job._arena;
+     job._arena = NULL;
+     vector<Block*>().swap(job._blocks);
+     vector<string>().swap(job._srcDNA);
+     vector<string>().swap(job._tgtDNA);
+     pthread_mutex_lock(&_mutex);
+     ++_numFinished;
+     pthread_cond_broadcast(&_cond);
+     pthread_mutex_unlock(&_mutex);
+   }
+
+protected:
+
+   void readJob(SequenceJob& job, size_t reader)
+   {
+     BlockArena* arena = new BlockArena();
+     vector<Block*> blocks;
+     try
+     {
+       _builder->computeBlocks(job._sequence, job._start, job._end,
+                               _target, blocks, *arena, reader);
+     }
+     catch(...)
+     {
+       delete arena;
+       throw;
+     }
+
+     // copy to read the DNA with below, as the main thread can start 
+     // on the blocks as soon as they are published
+     vector<Block> readerBlocks(blocks.size());
+     for (size_t i = 0; i < blocks.size(); ++i)
+     {
+       readerBlocks[i] = *blocks[i];
+     }
+     
+     pthread_mutex_lock(&_mutex);
+     job._arena = arena;
+     job._blocks.swap(blocks);
+     job._srcDNA.resize(job._blocks.size());
+     job._tgtDNA.resize(job._blocks.size());
+     job._blocksReady = true;
+     pthread_cond_broadcast(&_cond);
+     pthread_mutex_unlock(&_mutex);
+
+     // read the DNA in batches to limit locking
+     static const size_t batchSize = 256;
+     for (size_t i = 0; i < readerBlocks.size(); i += batchSize)
+     {
+       size_t last = min(i + batchSize, readerBlocks.size());
+       for (size_t j = i; j < last; ++j)
+       {
+         _builder->getBlockDNA(&readerBlocks[j], job._srcDNA[j],
+                               job._tgtDNA[j], reader);
+       }
+       pthread_mutex_lock(&_mutex);
+       job._dnaReady = last;
+       pthread_cond_broadcast(&_cond);
+       pthread_mutex_unlock(&_mutex);
+     }
+   }
+
+   SGBuilder* _builder;
+   vector<SequenceJob>& _jobs;
+   const Genome* _target;
+   size_t _window;
+   size_t _numFinished;
+   bool _aborted;
+   bool _failed;
+   pthread_mutex_t _mutex;
+   pthread_cond_t _cond;
+};
+
 void SGBuilder::addGenome(const Genome* genome,
                           const Sequence* sequence,
                           const set<const Sequence*>* refPathSequences,
@@ -215,6 +638,7 @@ void SGBuilder::addGenome(const Genome* genome,
   _lookup = new SGLookup();
   _lookup->init(seqNames);
   _luMap.insert(pair<string, SGLookup*>(genome->getName(), _lookup));
+  _treeIndex.mark(genome);
 
   // If sequence is not NULL, start in sequence coordinates and
   // need to be converted
@@ -225,6 +649,12 @@ void SGBuilder::addGenome(const Genome* genome,
 
   // Compute the target
   const Genome* target = getTarget(genome);
+  if (target != NULL)
+  {
+    // (only if the order was different from setGenomeOrder())
+    loadLookup(target);
+    preloadGenome(target);
+  }
   // Update the mapping structures.  Should verify with Joel what
   // these new parameters mean. 
   set<const Genome*> inputSet;
@@ -232,88 +662,1089 @@ void SGBuilder::addGenome(const Genome* genome,
   _mapMrca = genome;
   if (target != NULL)
   {
-    inputSet.insert(target);
-    _mapMrca = getLowestCommonAncestor(inputSet);
+    _mapMrca = _treeIndex.getLowestCommonAncestor(genome, target);
+  }
+  inputSet.clear();
+  inputSet.insert(_mapMrca);
+  inputSet.insert(target != NULL ? target : genome);
+  getGenomesInSpanningTree(inputSet, _mapPath);
+  _mapRoot = target != NULL ? getLowestCommonAncestor(_mapPath) : _root;
+
+  ///// DEBUG
+  cerr << "Mapping " << genome->getName() << " to "
+       << (target ? target->getName() : genome->getName())
+       << "; MRCA = " << (target ? _mapMrca->getName() : genome->getName())
+       << "; ROOT = " << _root->getName()
+       << "; PATH = ";\
+  for (set<const Genome*>::iterator i = _mapPath.begin();
+       i != _mapPath.end(); ++i)
+  {
+    cerr << (*i)->getName() << ", ";
+  }
+  cerr << endl;
+  /////
+  
+  // Get the range of every sequence to convert
+  sg_int_t firstSGSequence = _sg->getNumSequences();
+  size_t firstHalSequence = _halSequences.size();
+  vector<SequenceJob> jobs;
+  for (size_t i = 0; i < seqNames.size(); ++i)
+  {
+    const Sequence* curSequence = genome->getSequence(seqNames[i]);
+    hal_index_t endPos = start + length - 1;
+    hal_index_t curStart = std::max(start, curSequence->getStartPosition());
+    hal_index_t curEnd = std::min(endPos, curSequence->getEndPosition());
+
+    // note all coordinates global
+    if (curStart <= curEnd)
+    {
+      jobs.push_back(SequenceJob());
+      jobs.back()._sequence = curSequence;
+      jobs.back()._start = curStart;
+      jobs.back()._end = curEnd;
+      jobs.back()._blocksReady = false;
+      jobs.back()._arena = NULL;
+      jobs.back()._dnaReady = 0;
+    }
+  }
+
+  // The HAL mapping and DNA reading are the expensive parts and don't
+  // depend on the graph, so they are done ahead of time by the extra
+  // threads.  The graph is always updated serially (and in order) 
+  // below to keep the output independent of the number of threads. 
+  if (_threadPool.getNumThreads() > 1 && target != NULL &&
+      genome->getName() != _firstGenomeName && jobs.empty() == false)
+  {
+    prepareReaders(genome, target);
+    MapPipeline pipeline(this, jobs, target);
+    pipeline.start();
+    try
+    {
+      for (size_t i = 0; i < jobs.size(); ++i)
+      {
+        pipeline.waitForBlocks(jobs[i]);
+        mapSequence(jobs[i]._sequence, jobs[i]._start, jobs[i]._end, target,
+                    &jobs[i], &pipeline);
+        pipeline.finish(jobs[i]);
+        _halSequences.push_back(jobs[i]._sequence);
+      }
+    }
+    catch(...)
+    {
+      try
+      {
+        pipeline.stop();
+      }
+      catch(...)
+      {
+      }
+      for (size_t i = 0; i < jobs.size(); ++i)
+      {
+        pipeline.finish(jobs[i]);
+      }
+      throw;
+    }
+    pipeline.stop();
+  }
+  else
+  {
+    // Convert sequence by sequence
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+      mapSequence(jobs[i]._sequence, jobs[i]._start, jobs[i]._end, target);
+      _halSequences.push_back(jobs[i]._sequence);
+    }
+  }
+
+  if (genome->getName() == _firstGenomeName)
+  {
+    _numFirstGenomeSequences = _sg->getNumSequences();
+  }
+  saveLookup(genome, seqNames, firstHalSequence);
+  if (_checkpoint.isOpen() == true)
+  {
+    writeCheckpoint(genome, seqNames, firstSGSequence, firstHalSequence);
+  }
+  spillLookups(genome->getName());
+}
+
+/** Build the graph for one clade in a new builder, using the HAL handle
+ * belonging to the thread */
+class SGBuilder::BuildCladeTask : public SGThreadPool::Task
+{
+public:
+   BuildCladeTask(SGBuilder* builder, const Genome* reference,
+                  const vector<vector<const Genome*> >& clades,
+                  vector<SGBuilder*>& cladeBuilders) :
+     _builder(builder), _reference(reference), _clades(clades),
+     _cladeBuilders(cladeBuilders) {}
+
+   void run(size_t index, size_t threadIdx)
+   {
+     AlignmentConstPtr alignment = 
+        _builder->_readerPool.getAlignment(threadIdx);
+     SGBuilder* cladeBuilder = new SGBuilder();
+     _cladeBuilders[index] = cladeBuilder;
+     cladeBuilder->init(alignment,
+                        alignment->openGenome(_builder->_root->getName()),
+                        _builder->_referenceDupes,
+                        _builder->_camelMode,
+                        _builder->_onlySequenceNames,
+                        _builder->_stripSequenceNames);
+     cladeBuilder->setLazySequenceNames(_builder->_lazySequenceNames);
+     // clades share the memory budgets
+     cladeBuilder->setDNACacheSize(
+       splitBudget(_builder->_dnaCache.getMaxBytes()));
+     cladeBuilder->setMaxPreloadBytes(
+       splitBudget(_builder->_maxPreloadBytes));
+     cladeBuilder->setMaxSequenceDNABytes(
+       splitBudget(_builder->_sgDNA.getMaxBytes()));
+     cladeBuilder->setMaxMemory(splitBudget(_builder->_maxMemory));
+
+     const vector<const Genome*>& clade = _clades[index];
+     vector<const Genome*> genomes;
+     genomes.push_back(alignment->openGenome(_reference->getName()));
+     for (size_t i = 0; i < clade.size(); ++i)
+     {
+       genomes.push_back(alignment->openGenome(clade[i]->getName()));
+     }
+     if (_builder->_pendingTargetUses.empty() == false)
+     {
+       cladeBuilder->setGenomeOrder(genomes);
+     }
+     for (size_t i = 0; i < genomes.size(); ++i)
+     {
+       cladeBuilder->addGenome(genomes[i]);
+     }
+   }
+
+protected:
+
+   /** Each clade's share of a budget (0 still meaning none) */
+   size_t splitBudget(size_t maxBytes) const
+   {
+     return maxBytes == 0 ? 0 : max(maxBytes / _clades.size(), (size_t)1);
+   }
+   
+   SGBuilder* _builder;
+   const Genome* _reference;
+   const vector<vector<const Genome*> >& _clades;
+   vector<SGBuilder*>& _cladeBuilders;
+};
+
+void SGBuilder::addGenomesByClade(const vector<const Genome*>& genomes)
+{
+  assert(genomes.empty() == false);
+  if (_checkpoint.isOpen() == true)
+  {
+    throw hal_exception("checkpoints not supported when adding by clade");
+  }
+  const Genome* reference = genomes[0];
+  addGenome(reference);
+
+  // Group the rest of the genomes by the neighbour of the reference
+  // they are reached through.  Targets are never chosen across
+  // clades since the reference is always closer, so each clade
+  // can be built independently.
+  vector<vector<const Genome*> > clades;
+  map<const Genome*, size_t> cladeMap;
+  for (size_t i = 1; i < genomes.size(); ++i)
+  {
+    const Genome* neighbour = reference->getParent();
+    for (const Genome* g = genomes[i]; g != NULL; g = g->getParent())
+    {
+      if (g->getParent() == reference)
+      {
+        neighbour = g;
+        break;
+      }
+    }
+    map<const Genome*, size_t>::iterator ci = cladeMap.insert(
+      pair<const Genome*, size_t>(neighbour, clades.size())).first;
+    if (ci->second == clades.size())
+    {
+      clades.push_back(vector<const Genome*>());
+    }
+    clades[ci->second].push_back(genomes[i]);
+  }
+
+  // Genomes above a leaf reference all hang off its parent, and a path
+  // of ancestors can't be split up since each maps onto the one below.
+  // There's nothing to do in parallel then, so skip the clade builder
+  // (which would map the reference again) and the merge.
+  if (clades.size() == 1)
+  {
+    cerr << "Warning: all genomes are in a single clade of the reference "
+         << reference->getName() << ", so they are added serially" << endl;
+    for (size_t i = 0; i < clades[0].size(); ++i)
+    {
+      addGenome(clades[0][i]);
+    }
+    return;
+  }
+
+  vector<SGBuilder*> cladeBuilders(clades.size(), NULL);
+  BuildCladeTask task(this, reference, clades, cladeBuilders);
+  try
+  {
+    _threadPool.parallelFor(clades.size(), &task);
+  }
+  catch(...)
+  {
+    for (size_t i = 0; i < cladeBuilders.size(); ++i)
+    {
+      delete cladeBuilders[i];
+    }
+    throw;
+  }
+
+  // merge in clade order to keep output deterministic
+  for (size_t i = 0; i < cladeBuilders.size(); ++i)
+  {
+    cerr << "Merging clade " << i << " (" << clades[i].size()
+         << " genomes)" << endl;
+    mergeBuilder(*cladeBuilders[i]);
+    delete cladeBuilders[i];
+    cladeBuilders[i] = NULL;
+  }
+}
+
+void SGBuilder::mergeBuilder(SGBuilder& other)
+{
+  assert(other._firstGenomeName == _firstGenomeName);
+  assert(other._numFirstGenomeSequences == _numFirstGenomeSequences);
+  sg_int_t numShared = _numFirstGenomeSequences;
+
+  // other's sequences are either copied whole (seqMap gives new ID) or 
+  // are SNP sequences with some bases that already exist in our graph
+  // (dupeMap gives new position for each base).  The bases that don't
+  // exist yet are copied into new sequences, one per run. 
+  vector<sg_int_t> seqMap(other._sg->getNumSequences(), -1);
+  map<sg_int_t, vector<SGPosition> > dupeMap;
+  for (sg_int_t i = 0; i < numShared; ++i)
+  {
+    assert(_sg->getSequence(i)->getLength() ==
+           other._sg->getSequence(i)->getLength());
+    seqMap[i] = i;
+  }
+
+  char nuc;
+  char anchorNuc;
+  SGPosition anchor;
+  for (sg_int_t i = numShared; i < other._sg->getNumSequences(); ++i)
+  {
+    const SGSequence* otherSeq = other._sg->getSequence(i);
+
+    // note: anchors are never in SNP sequences so are always in seqMap
+    vector<SGPosition> dupePositions(otherSeq->getLength(),
+                                     SideGraph::NullPos);
+    sg_int_t numDupes = 0;
+    for (sg_int_t j = 0; j < otherSeq->getLength(); ++j)
+    {
+      if (other._snpHandler->getSNPAnchor(SGPosition(i, j), nuc,
+                                          anchor, anchorNuc))
+      {
+        assert(seqMap[anchor.getSeqID()] >= 0);
+        anchor.setSeqID(seqMap[anchor.getSeqID()]);
+        dupePositions[j] = _snpHandler->findSNP(anchor, nuc);
+        if (dupePositions[j] != SideGraph::NullPos)
+        {
+          ++numDupes;
+        }
+      }
+    }
+
+    for (sg_int_t j = 0; j < otherSeq->getLength(); )
+    {
+      if (dupePositions[j] != SideGraph::NullPos)
+      {
+        ++j;
+        continue;
+      }
+      sg_int_t k = j + 1;
+      while (k < otherSeq->getLength() &&
+             dupePositions[k] == SideGraph::NullPos)
+      {
+        ++k;
+      }
+      sg_int_t newSeqID = mergeSequenceRun(other, i, j, k - j, seqMap);
+      for (sg_int_t l = j; l < k; ++l)
+      {
+        dupePositions[l] = SGPosition(newSeqID, l - j);
+      }
+      j = k;
+    }
+
+    if (numDupes == 0)
+    {
+      // never empty: createSGSequence() and the SNP handler only make
+      // sequences of at least one base, so the run above set this
+      assert(otherSeq->getLength() > 0);
+      seqMap[i] = dupePositions[0].getSeqID();
+    }
+    else
+    {
+      dupeMap[i].swap(dupePositions);
+    }
+  }
+
+  // rebuild the lookups of other's genomes from their paths.  other's 
+  // lookups may have been spilled, so each is reloaded in turn and 
+  // freed once its genome's sequences are done
+  vector<pair<const Genome*, vector<string> > > mergedGenomes;
+  size_t firstHalSequence = _halSequences.size();
+  const Genome* prevOtherGenome = NULL;
+  for (size_t i = 0; i < other._halSequences.size(); ++i)
+  {
+    const Sequence* otherSequence = other._halSequences[i];
+    const Genome* otherGenome = otherSequence->getGenome();
+    if (otherGenome->getName() == _firstGenomeName)
+    {
+      continue;
+    }
+    if (otherGenome != prevOtherGenome)
+    {
+      if (prevOtherGenome != NULL)
+      {
+        other.freeLookup(prevOtherGenome);
+      }
+      other.loadLookup(otherGenome);
+      prevOtherGenome = otherGenome;
+    }
+    const Sequence* sequence = mergeSequence(otherSequence);
+    GenomeLUMap::iterator lui = _luMap.find(otherGenome->getName());
+    if (lui == _luMap.end())
+    {
+      const Genome* genome = sequence->getGenome();
+      vector<string> seqNames;
+      SequenceIteratorPtr si = genome->getSequenceIterator();
+      for (size_t j = 0; j < genome->getNumSequences(); ++j, si->toNext())
+      {
+        seqNames.push_back(si->getSequence()->getName());
+      }
+      SGLookup* lookup = new SGLookup();
+      lookup->init(seqNames);
+      lui = _luMap.insert(pair<string, SGLookup*>(genome->getName(),
+                                                  lookup)).first;
+      _treeIndex.mark(genome);
+      mergedGenomes.push_back(pair<const Genome*, vector<string> >(
+                                genome, seqNames));
+    }
+    vector<SGSegment> path;
+    other.getHalSequencePath(otherSequence, path);
+    hal_index_t halPos = 0;
+    for (size_t j = 0; j < path.size(); ++j)
+    {
+      mergeLookupSegment(lui->second, (sg_int_t)sequence->getArrayIndex(),
+                         halPos, path[j], seqMap, dupeMap);
+      halPos += path[j].getLength();
+    }
+    _halSequences.push_back(sequence);
+  }
+  if (prevOtherGenome != NULL)
+  {
+    other.freeLookup(prevOtherGenome);
+  }
+
+  for (size_t i = 0; i < mergedGenomes.size(); ++i)
+  {
+    saveLookup(mergedGenomes[i].first, mergedGenomes[i].second,
+               firstHalSequence);
+    spillLookups(mergedGenomes[i].first->getName());
+  }
+}
+
+sg_int_t SGBuilder::mergeSequenceRun(const SGBuilder& other, 
+                                    sg_int_t otherSeqID,
+                                    sg_int_t start, sg_int_t length,
+                                    const vector<sg_int_t>& seqMap)
+{
+  const SGSequence* otherSeq = other._sg->getSequence(otherSeqID);
+  bool whole = start == 0 && length == otherSeq->getLength();
+
+  vector<SGSegment> segPath;
+  vector<const Sequence*> halSeqPath;
+  other._lookBack.getPath(SGPosition(otherSeqID, start), length, true,
+                          segPath, halSeqPath);
+
+  string name = otherSeq->getName();
+  if (whole == false && name.empty() == false)
+  {
+    // SNP names end with the HAL range they come from, which we cut
+    // down to the run 
+    vector<SGSegment> wholePath;
+    vector<const Sequence*> wholeHalSeqPath;
+    other._lookBack.getPath(SGPosition(otherSeqID, 0), 
+                            otherSeq->getLength(), true,
+                            wholePath, wholeHalSeqPath);
+    string range;
+    SGSeqNames::appendRange(range, getMinHalPos(wholePath),
+                            otherSeq->getLength());
+    if (name.length() >= range.length() &&
+        name.compare(name.length() - range.length(), range.length(),
+                     range) == 0)
+    {
+      name.erase(name.length() - range.length());
+      SGSeqNames::appendRange(name, getMinHalPos(segPath), length);
+    }
+  }
+
+  const SGSequence* newSeq = _sg->addSequence(
+    new SGSequence(-1, length, name));
+  if (other._seqNames.hasOrigin(otherSeqID))
+  {
+    const Sequence* origin = other._seqNames.getHalSequence(otherSeqID);
+    _seqNames.setOrigin(newSeq->getID(), 
+                        origin == NULL ? NULL : mergeSequence(origin),
+                        whole ? other._seqNames.getOffset(otherSeqID) :
+                        getMinHalPos(segPath),
+                        whole ? other._seqNames.getLength(otherSeqID) :
+                        length);
+  }
+  if (other.isSNPSequence(otherSeqID))
+  {
+    _snpSequences.resize(newSeq->getID(), false);
+    _snpSequences.push_back(true);
+  }
+  const PackedDNA* otherDNA = other._sgDNA.get(otherSeqID,
+                                               otherSeq->getLength());
+  if (otherDNA != NULL)
+  {
+    if (whole == true)
+    {
+      _sgDNA.add(newSeq->getID(), *otherDNA);
+    }
+    else
+    {
+      string dna;
+      otherDNA->getSubString(dna, start, length);
+      _sgDNA.add(newSeq->getID(), dna);
+    }
+  }
+
+  // add its snps to our handler so they can be found by other clades
+  char nuc;
+  char anchorNuc;
+  SGPosition anchor;
+  for (sg_int_t j = 0; j < length; ++j)
+  {
+    if (other._snpHandler->getSNPAnchor(SGPosition(otherSeqID, start + j),
+                                        nuc, anchor, anchorNuc))
+    {
+      anchor.setSeqID(seqMap[anchor.getSeqID()]);
+      if (_snpHandler->findSNP(anchor, anchorNuc) == SideGraph::NullPos)
+      {
+        _snpHandler->addSNP(anchor, anchorNuc, anchor);
+      }
+      assert(_snpHandler->findSNP(anchor, nuc) == SideGraph::NullPos);
+      _snpHandler->addSNP(anchor, nuc, SGPosition(newSeq->getID(), j));
+    }
+  }
+
+  // and copy where it came from in HAL
+  sg_int_t pos = 0;
+  for (size_t j = 0; j < segPath.size(); ++j)
+  {
+    const SGSegment& seg = segPath[j];
+    _lookBack.addInterval(SGPosition(newSeq->getID(), pos),
+                          mergeSequence(halSeqPath[j]),
+                          seg.getMinPos().getPos(), seg.getLength(),
+                          !seg.getSide().getForward());
+    pos += seg.getLength();
+  }
+  return newSeq->getID();
+}
+
+hal_index_t SGBuilder::getMinHalPos(const vector<SGSegment>& path)
+{
+  assert(path.empty() == false);
+  hal_index_t minPos = path[0].getMinPos().getPos();
+  for (size_t i = 1; i < path.size(); ++i)
+  {
+    minPos = min(minPos, (hal_index_t)path[i].getMinPos().getPos());
+  }
+  return minPos;
+}
+
+void SGBuilder::mergeLookupSegment(SGLookup* lookup, sg_int_t halSeqID,
+                                   hal_index_t halStart, const SGSegment& seg,
+                                   const vector<sg_int_t>& seqMap,
+                                   const map<sg_int_t, vector<SGPosition> >&
+                                   dupeMap)
+{
+  bool reversed = !seg.getSide().getForward();
+  sg_int_t seqID = seg.getSide().getBase().getSeqID();
+  map<sg_int_t, vector<SGPosition> >::const_iterator di = dupeMap.find(seqID);
+  if (di == dupeMap.end())
+  {
+    assert(seqMap[seqID] >= 0);
+    SGPosition minPos = seg.getMinPos();
+    minPos.setSeqID(seqMap[seqID]);
+    lookup->addInterval(SGPosition(halSeqID, halStart), minPos,
+                        seg.getLength(), reversed);
+    return;
+  }
+
+  // deduplicated SNP sequence: its bases may be spread over several of 
+  // our sequences so add an interval for each contiguous run.
+  const vector<SGPosition>& positions = di->second;
+  sg_int_t basePos = seg.getSide().getBase().getPos();
+  sg_int_t delta = reversed ? -1 : 1;
+  for (sg_int_t k = 0; k < seg.getLength(); )
+  {
+    const SGPosition& first = positions[basePos + k * delta];
+    sg_int_t run = 1;
+    for (; k + run < seg.getLength(); ++run)
+    {
+      const SGPosition& next = positions[basePos + (k + run) * delta];
+      if (next.getSeqID() != first.getSeqID() ||
+          next.getPos() != first.getPos() + run * delta)
+      {
+        break;
+      }
+    }
+    SGPosition minPos = first;
+    if (reversed == true)
+    {
+      minPos.setPos(first.getPos() - run + 1);
+    }
+    lookup->addInterval(SGPosition(halSeqID, halStart + k), minPos, run,
+                        reversed);
+
+    k += run;
+  }
+}
+
+const Sequence* SGBuilder::mergeSequence(const Sequence* sequence)
+{
+  map<const Sequence*, const Sequence*>::iterator i =
+     _mergeSeqMap.find(sequence);
+  if (i == _mergeSeqMap.end())
+  {
+    const Genome* genome = _alignment->openGenome(
+      sequence->getGenome()->getName());
+    i = _mergeSeqMap.insert(pair<const Sequence*, const Sequence*>(
+                              sequence,
+                              genome->getSequence(sequence->getName()))).first;
+  }
+  return i->second;
+}
+
+void SGBuilder::computeJoins(bool doAncestralJoins, PathSink* pathSink)
+{
+  vector<const Sequence*> sequences;
+  for (size_t i = 0; i < _halSequences.size(); ++i)
+  {
+    if (doAncestralJoins ||
+        _halSequences[i]->getGenome()->getNumChildren() == 0)
+    {
+      sequences.push_back(_halSequences[i]);
+    }
+  }
+
+  if (_threadPool.getNumThreads() > 1)
+  {
+    computeJoinsParallel(sequences, pathSink);
+  }
+  else
+  {
+    // number of paths left for each genome, so we know when we can 
+    // free its lookup
+    map<const Genome*, size_t> pathCounts;
+    for (size_t i = 0; i < sequences.size() && pathSink != NULL; ++i)
+    {
+      ++pathCounts[sequences[i]->getGenome()];
+    }
+    
+    for (size_t i = 0; i < sequences.size(); ++i)
+    {
+      vector<SGSegment> path;
+      loadLookup(sequences[i]->getGenome());
+      getHalSequencePath(sequences[i], path);
+      addPathJoins(sequences[i], path);
+      if (pathSink != NULL)
+      {
+        pathSink->writePath(i, 0, sequences[i], path);
+        if (--pathCounts[sequences[i]->getGenome()] == 0)
+        {
+          freeLookup(sequences[i]->getGenome());
+        }
+      }
+    }
+  }
+
+  if (pathSink != NULL)
+  {
+    // nothing else will use the lookups (ie of skipped ancestors)
+    for (GenomeLUMap::iterator i = _luMap.begin(); i != _luMap.end(); ++i)
+    {
+      delete i->second;
+      i->second = NULL;
+    }
+    _lookup = NULL;
+    for (LookupSpillMap::iterator i = _lookupSpills.begin(); 
+         i != _lookupSpills.end(); ++i)
+    {
+      delete i->second;
+      i->second = NULL;
+    }
+  }
+}
+
+void SGBuilder::freeLookup(const Genome* genome)
+{
+  GenomeLUMap::iterator lui = _luMap.find(genome->getName());
+  assert(lui != _luMap.end());
+  if (lui->second == _lookup)
+  {
+    _lookup = NULL;
+  }
+  delete lui->second;
+  lui->second = NULL;
+  // no reloading it either
+  LookupSpillMap::iterator lsi = _lookupSpills.find(genome->getName());
+  if (lsi != _lookupSpills.end())
+  {
+    delete lsi->second;
+    lsi->second = NULL;
+  }
+}
+
+void SGBuilder::saveLookup(const Genome* genome,
+                           const vector<string>& seqNames,
+                           size_t firstHalSequence)
+{
+  if (_maxMemory == 0 ||
+      _pendingTargetUses.find(genome->getName()) == _pendingTargetUses.end())
+  {
+    return;
+  }
+  assert(_lookupSpills.find(genome->getName()) == _lookupSpills.end());
+  LookupSpill* lookupSpill = new LookupSpill();
+  _lookupSpills.insert(pair<string, LookupSpill*>(genome->getName(),
+                                                  lookupSpill));
+  lookupSpill->init(seqNames);
+  vector<SGSegment> path;
+  for (size_t i = firstHalSequence; i < _halSequences.size(); ++i)
+  {
+    if (_halSequences[i]->getGenome()->getName() == genome->getName())
+    {
+      const Sequence* sequence = _halSequences[i];
+      getHalSequencePath(sequence, path);
+      lookupSpill->addPath((sg_int_t)sequence->getArrayIndex(), path);
+    }
+  }
+}
+
+void SGBuilder::spillLookups(const string& genomeName)
+{
+  map<string, string>::iterator pti = _plannedTargets.find(genomeName);
+  if (pti != _plannedTargets.end())
+  {
+    map<string, size_t>::iterator ptu = _pendingTargetUses.find(pti->second);
+    assert(ptu != _pendingTargetUses.end());
+    if (ptu->second > 0)
+    {
+      --ptu->second;
+    }
+  }
+  if (_maxMemory == 0)
+  {
+    return;
+  }
+  
+  // resident lookups, and those that no genome still to come maps to.
+  // the DNA store counts towards the total too
+  size_t bytes = _sgDNA.getNumBytes();
+  vector<pair<size_t, string> > finished;
+  for (LookupSpillMap::iterator i = _lookupSpills.begin();
+       i != _lookupSpills.end(); ++i)
+  {
+    GenomeLUMap::iterator lui = _luMap.find(i->first);
+    assert(lui != _luMap.end());
+    if (i->second != NULL && lui->second != NULL)
+    {
+      size_t numIntervals = i->second->getNumIntervals();
+      bytes += numIntervals * LookupIntervalBytes;
+      map<string, size_t>::iterator ptu = _pendingTargetUses.find(i->first);
+      if (ptu != _pendingTargetUses.end() && ptu->second == 0)
+      {
+        finished.push_back(pair<size_t, string>(numIntervals, i->first));
+      }
+    }
+  }
+
+  sort(finished.begin(), finished.end());
+  for (size_t i = finished.size(); i > 0 && bytes > _maxMemory; --i)
+  {
+    GenomeLUMap::iterator lui = _luMap.find(finished[i - 1].second);
+    if (lui->second == _lookup)
+    {
+      _lookup = NULL;
+    }
+    delete lui->second;
+    lui->second = NULL;
+    bytes -= finished[i - 1].first * LookupIntervalBytes;
+    ++_numSpilledLookups;
+  }
+}
+
+void SGBuilder::writeCheckpoint(const Genome* genome,
+                                const vector<string>& seqNames,
+                                sg_int_t firstSGSequence,
+                                size_t firstHalSequence)
+{
+  string record;
+  SGCheckpoint::putString(record, genome->getName());
+
+  // new side graph sequences, with where they come from in HAL, and 
+  // the anchors of any SNP bases
+  SGCheckpoint::putInt(record, firstSGSequence);
+  SGCheckpoint::putInt(record, _sg->getNumSequences() - firstSGSequence);
+  vector<SGSegment> segPath;
+  vector<const Sequence*> halSeqPath;
+  char nuc;
+  char anchorNuc;
+  SGPosition anchor;
+  for (sg_int_t i = firstSGSequence; i < _sg->getNumSequences(); ++i)
+  {
+    const SGSequence* sgSeq = _sg->getSequence(i);
+    SGCheckpoint::putInt(record, sgSeq->getLength());
+    SGCheckpoint::putString(record, sgSeq->getName());
+    SGCheckpoint::putInt(record, _seqNames.hasOrigin(i) ? 1 : 0);
+    if (_seqNames.hasOrigin(i) == true)
+    {
+      const Sequence* origin = _seqNames.getHalSequence(i);
+      SGCheckpoint::putString(record, origin->getGenome()->getName());
+      SGCheckpoint::putString(record, origin->getName());
+      SGCheckpoint::putInt(record, _seqNames.getOffset(i));
+      SGCheckpoint::putInt(record, _seqNames.getLength(i));
+    }
+    SGCheckpoint::putInt(record, isSNPSequence(i) ? 1 : 0);
+    segPath.clear();
+    halSeqPath.clear();
+    if (sgSeq->getLength() > 0)
+    {
+      _lookBack.getPath(SGPosition(i, 0), sgSeq->getLength(), true,
+                        segPath, halSeqPath);
+    }
+    SGCheckpoint::putInt(record, segPath.size());
+    for (size_t j = 0; j < segPath.size(); ++j)
+    {
+      SGCheckpoint::putString(record, halSeqPath[j]->getGenome()->getName());
+      SGCheckpoint::putString(record, halSeqPath[j]->getName());
+      SGCheckpoint::putInt(record, segPath[j].getMinPos().getPos());
+      SGCheckpoint::putInt(record, segPath[j].getLength());
+      SGCheckpoint::putInt(record, segPath[j].getSide().getForward() ? 0 : 1);
+    }
+    string anchors;
+    sg_int_t numAnchors = 0;
+    for (sg_int_t j = 0; j < sgSeq->getLength() && isSNPSequence(i); ++j)
+    {
+      if (_snpHandler->getSNPAnchor(SGPosition(i, j), nuc, anchor,
+                                    anchorNuc) == true)
+      {
+        SGCheckpoint::putInt(anchors, j);
+        SGCheckpoint::putInt(anchors, anchor.getSeqID());
+        SGCheckpoint::putInt(anchors, anchor.getPos());
+        SGCheckpoint::putInt(anchors, nuc);
+        SGCheckpoint::putInt(anchors, anchorNuc);
+        ++numAnchors;
+      }
+    }
+    SGCheckpoint::putInt(record, numAnchors);
+    record.append(anchors);
+  }
+
+  // the genome's lookup, as the paths of its sequences
+  SGCheckpoint::putInt(record, seqNames.size());
+  for (size_t i = 0; i < seqNames.size(); ++i)
+  {
+    SGCheckpoint::putString(record, seqNames[i]);
+  }
+  SGCheckpoint::putInt(record, _halSequences.size() - firstHalSequence);
+  for (size_t i = firstHalSequence; i < _halSequences.size(); ++i)
+  {
+    SGCheckpoint::putString(record, _halSequences[i]->getName());
+    getHalSequencePath(_halSequences[i], segPath);
+    SGCheckpoint::putInt(record, segPath.size());
+    for (size_t j = 0; j < segPath.size(); ++j)
+    {
+      SGPosition minPos = segPath[j].getMinPos();
+      SGCheckpoint::putInt(record, minPos.getSeqID());
+      SGCheckpoint::putInt(record, minPos.getPos());
+      SGCheckpoint::putInt(record, segPath[j].getSide().getForward() ? 
+                           segPath[j].getLength() : -segPath[j].getLength());
+    }
+  }
+  
+  _checkpoint.writeRecord(record);
+}
+
+const Genome* SGBuilder::restoreCheckpoint(const string& record)
+{
+  SGCheckpoint::Reader reader(record);
+  const Genome* genome = _alignment->openGenome(reader.getString());
+  if (genome == NULL || _luMap.find(genome->getName()) != _luMap.end())
+  {
+    throw hal_exception("checkpoint " + _checkpoint.getPath() + 
+                        " doesn't match the alignment");
+  }
+  if (_firstGenomeName.empty())
+  {
+    _firstGenomeName = genome->getName();
+  }
+
+  sg_int_t firstSGSequence = reader.getInt();
+  sg_int_t numSGSequences = reader.getInt();
+  if (firstSGSequence != _sg->getNumSequences())
+  {
+    throw hal_exception("checkpoint " + _checkpoint.getPath() + 
+                        " is corrupt");
+  }
+  for (sg_int_t i = 0; i < numSGSequences; ++i)
+  {
+    sg_int_t length = reader.getInt();
+    string name = reader.getString();
+    bool hasOrigin = reader.getInt() != 0;
+    const SGSequence* sgSeq = _sg->addSequence(
+      new SGSequence(-1, length, name));
+    if (hasOrigin == true)
+    {
+      const Sequence* origin = readCheckpointSequence(reader);
+      hal_index_t offset = reader.getInt();
+      _seqNames.setOrigin(sgSeq->getID(), origin, offset, reader.getInt());
+    }
+    bool snp = reader.getInt() != 0;
+    if (snp == true)
+    {
+      _snpSequences.resize(sgSeq->getID(), false);
+      _snpSequences.push_back(true);
+    }
+    sg_int_t numSegments = reader.getInt();
+    sg_int_t pos = 0;
+    for (sg_int_t j = 0; j < numSegments; ++j)
+    {
+      const Sequence* halSeq = readCheckpointSequence(reader);
+      hal_index_t halPos = reader.getInt();
+      sg_int_t segLength = reader.getInt();
+      bool reversed = reader.getInt() != 0;
+      _lookBack.addInterval(SGPosition(sgSeq->getID(), pos), halSeq,
+                            halPos, segLength, reversed);
+      pos += segLength;
+    }
+    // same as merging another builder's SNPs
+    sg_int_t numAnchors = reader.getInt();
+    for (sg_int_t j = 0; j < numAnchors; ++j)
+    {
+      SGPosition snpPos(sgSeq->getID(), reader.getInt());
+      sg_int_t anchorSeqID = reader.getInt();
+      SGPosition anchor(anchorSeqID, reader.getInt());
+      char nuc = (char)reader.getInt();
+      char anchorNuc = (char)reader.getInt();
+      if (_snpHandler->findSNP(anchor, anchorNuc) == SideGraph::NullPos)
+      {
+        _snpHandler->addSNP(anchor, anchorNuc, anchor);
+      }
+      if (_snpHandler->findSNP(anchor, nuc) == SideGraph::NullPos)
+      {
+        _snpHandler->addSNP(anchor, nuc, snpPos);
+      }
+    }
+  }
+
+  vector<string> seqNames(reader.getInt());
+  for (size_t i = 0; i < seqNames.size(); ++i)
+  {
+    seqNames[i] = reader.getString();
+  }
+  _lookup = new SGLookup();
+  _lookup->init(seqNames);
+  _luMap.insert(pair<string, SGLookup*>(genome->getName(), _lookup));
+  _treeIndex.mark(genome);
+  size_t firstHalSequence = _halSequences.size();
+  sg_int_t numHalSequences = reader.getInt();
+  for (sg_int_t i = 0; i < numHalSequences; ++i)
+  {
+    const Sequence* sequence = genome->getSequence(reader.getString());
+    if (sequence == NULL)
+    {
+      throw hal_exception("checkpoint " + _checkpoint.getPath() + 
+                          " doesn't match the alignment");
+    }
+    sg_int_t numSegments = reader.getInt();
+    hal_index_t halPos = 0;
+    for (sg_int_t j = 0; j < numSegments; ++j)
+    {
+      sg_int_t seqID = reader.getInt();
+      SGPosition minPos(seqID, reader.getInt());
+      sg_int_t length = reader.getInt();
+      _lookup->addInterval(SGPosition(sequence->getArrayIndex(), halPos),
+                           minPos, length < 0 ? -length : length, length < 0);
+      halPos += length < 0 ? -length : length;
+    }
+    _halSequences.push_back(sequence);
   }
-  inputSet.clear();
-  inputSet.insert(_mapMrca);
-  inputSet.insert(target != NULL ? target : genome);
-  getGenomesInSpanningTree(inputSet, _mapPath);
-  _mapRoot = target != NULL ? getLowestCommonAncestor(_mapPath) : _root;
 
-  ///// DEBUG
-  cerr << "Mapping " << genome->getName() << " to "
-       << (target ? target->getName() : genome->getName())
-       << "; MRCA = " << (target ? _mapMrca->getName() : genome->getName())
-       << "; ROOT = " << _root->getName()
-       << "; PATH = ";\
-  for (set<const Genome*>::iterator i = _mapPath.begin();
-       i != _mapPath.end(); ++i)
+  if (genome->getName() == _firstGenomeName)
   {
-    cerr << (*i)->getName() << ", ";
+    _numFirstGenomeSequences = _sg->getNumSequences();
   }
-  cerr << endl;
-  /////
-  
-  // Convert sequence by sequence
-  for (size_t i = 0; i < seqNames.size(); ++i)
+  saveLookup(genome, seqNames, firstHalSequence);
+  spillLookups(genome->getName());
+  return genome;
+}
+
+const Sequence* SGBuilder::readCheckpointSequence(
+  SGCheckpoint::Reader& reader) const
+{
+  string genomeName = reader.getString();
+  string sequenceName = reader.getString();
+  const Genome* genome = _alignment->openGenome(genomeName);
+  const Sequence* sequence = genome == NULL ? NULL :
+     genome->getSequence(sequenceName);
+  if (sequence == NULL)
   {
-    const Sequence* curSequence = genome->getSequence(seqNames[i]);
-    hal_index_t endPos = start + length - 1;
-    hal_index_t curStart = std::max(start, curSequence->getStartPosition());
-    hal_index_t curEnd = std::min(endPos, curSequence->getEndPosition());
+    throw hal_exception("checkpoint " + _checkpoint.getPath() + 
+                        " doesn't match the alignment");
+  }
+  return sequence;
+}
 
-    // note all coordinates global
-    if (curStart <= curEnd)
+void SGBuilder::loadLookup(const Genome* genome)
+{
+  LookupSpillMap::iterator lsi = _lookupSpills.find(genome->getName());
+  if (lsi != _lookupSpills.end() && lsi->second != NULL)
+  {
+    GenomeLUMap::iterator lui = _luMap.find(genome->getName());
+    assert(lui != _luMap.end());
+    if (lui->second == NULL)
     {
-//      if ((seqNames[i].length() > 5 && seqNames[i].substr(0,5) == "chr1_") || seqNames[i] == "chr1")
-      {
-      mapSequence(curSequence, curStart, curEnd, target);
-      _halSequences.push_back(curSequence);
-      }
+      lui->second = lsi->second->load();
     }
   }
 }
 
-void SGBuilder::computeJoins(bool doAncestralJoins)
+/** Compute the joins (and do the consistency check) for one path,
+ * using the HAL handle belonging to the thread.  Joins are kept in 
+ * a buffer for each thread, since the graph can't be modified in 
+ * parallel. */
+class SGBuilder::PathJoinsTask : public SGThreadPool::Task
 {
-  for (size_t i = 0; i < _halSequences.size(); ++i)
+public:
+   PathJoinsTask(SGBuilder* builder, const vector<const Sequence*>& sequences,
+                 PathSink* pathSink)
+     : _builder(builder), _sequences(sequences),
+       _joins(builder->_threadPool.getNumThreads()),
+       _dedupedSize(builder->_threadPool.getNumThreads(), 0),
+       _pathSink(pathSink)
+   {
+     pthread_mutex_init(&_mutex, NULL);
+     for (size_t i = 0; i < _sequences.size() && _pathSink != NULL; ++i)
+     {
+       ++_pathCounts[_sequences[i]->getGenome()];
+     }
+   }
+
+   ~PathJoinsTask()
+   {
+     pthread_mutex_destroy(&_mutex);
+   }
+
+   void run(size_t index, size_t threadIdx)
+   {
+     vector<SGSegment> path;
+     pthread_mutex_lock(&_mutex);
+     try
+     {
+       _builder->loadLookup(_sequences[index]->getGenome());
+     }
+     catch(...)
+     {
+       pthread_mutex_unlock(&_mutex);
+       throw;
+     }
+     pthread_mutex_unlock(&_mutex);
+     _builder->getHalSequencePath(_sequences[index], path);
+     vector<pair<SGSide, SGSide> >& joins = _joins[threadIdx];
+     _builder->addPathJoins(_sequences[index], path, &joins, threadIdx);
+     // paths reuse lots of joins, so dedupe as we go to save memory
+     // (whenever the buffer has doubled since the last time)
+     if (joins.size() > 2 * _dedupedSize[threadIdx] + 1024)
+     {
+       sort(joins.begin(), joins.end());
+       joins.erase(unique(joins.begin(), joins.end()), joins.end());
+       _dedupedSize[threadIdx] = joins.size();
+     }
+     if (_pathSink != NULL)
+     {
+       _pathSink->writePath(index, threadIdx, _sequences[index], path);
+       const Genome* genome = _sequences[index]->getGenome();
+       // freeLookup() changes the same builder state as loadLookup()
+       pthread_mutex_lock(&_mutex);
+       if (--_pathCounts[genome] == 0)
+       {
+         _builder->freeLookup(genome);
+       }
+       pthread_mutex_unlock(&_mutex);
+     }
+   }
+
+   vector<pair<SGSide, SGSide> >& getJoins(size_t threadIdx)
+   {
+     return _joins[threadIdx];
+   }
+
+protected:
+   
+   SGBuilder* _builder;
+   const vector<const Sequence*>& _sequences;
+   vector<vector<pair<SGSide, SGSide> > > _joins;
+   // size of each thread's joins after they were last deduped
+   vector<size_t> _dedupedSize;
+   PathSink* _pathSink;
+   // number of paths left for each genome
+   map<const Genome*, size_t> _pathCounts;
+   pthread_mutex_t _mutex;
+};
+
+void SGBuilder::computeJoinsParallel(const vector<const Sequence*>& sequences,
+                                     PathSink* pathSink)
+{
+  set<const Genome*> genomes;
+  for (size_t i = 0; i < sequences.size(); ++i)
   {
-    vector<SGSegment> path;
-    getHalSequencePath(_halSequences[i], path);
-    if (doAncestralJoins ||
-        _halSequences[i]->getGenome()->getNumChildren() == 0)
+    if (genomes.insert(sequences[i]->getGenome()).second == true)
     {
-      addPathJoins(_halSequences[i], path);
+      _readerPool.openGenome(sequences[i]->getGenome());
     }
   }
+
+  PathJoinsTask task(this, sequences, pathSink);
+  _threadPool.parallelFor(sequences.size(), &task);
+
+  vector<pair<SGSide, SGSide> > joins;
+  for (size_t i = 0; i < _threadPool.getNumThreads(); ++i)
+  {
+    vector<pair<SGSide, SGSide> >& threadJoins = task.getJoins(i);
+    joins.insert(joins.end(), threadJoins.begin(), threadJoins.end());
+    vector<pair<SGSide, SGSide> >().swap(threadJoins);
+  }
+  sort(joins.begin(), joins.end());
+  joins.erase(unique(joins.begin(), joins.end()), joins.end());
+  
+  for (size_t i = 0; i < joins.size(); ++i)
+  {
+    createSGJoin(joins[i].first, joins[i].second);
+  }
 }
 
 const Genome* SGBuilder::getTarget(const Genome* genome)
 {
-  // This code may be too dumb to be any more than a placeholder, but
-  // have no short term designs on huge trees...
-
   // find the nearest genome in our hal tree that's already been added
-  // to the lookup structure.
-  size_t dist = numeric_limits<size_t>::max();
-  const Genome* best = NULL;
-  for (GenomeLUMap::const_iterator i = _luMap.begin(); i != _luMap.end(); ++i)
-  {
-    const Genome* candidate = _alignment->openGenome(i->first);
-
-    set<const Genome*> inputSet;
-    inputSet.insert(genome);
-    inputSet.insert(candidate);
-    set<const Genome*> spanningTree;
-    getGenomesInSpanningTree(inputSet, spanningTree);
-    if (spanningTree.size() > 1 && spanningTree.size() < dist)
-    {
-      dist = spanningTree.size();
-      best = candidate;
-    }
-  }
-  return best;
+  // to the lookup structure (they are all marked in the tree index).
+  // ties go to the smallest name, as when this was a scan of _luMap
+  return _treeIndex.getNearestMarked(genome);
 }
 
 pair<SGSide, SGSide> SGBuilder::createSGSequence(const Sequence* sequence,
@@ -333,7 +1764,7 @@ pair<SGSide, SGSide> SGBuilder::createSGSequence(const Sequence* sequence,
   {
     computeBlocks(sequence, sequence->getStartPosition() + startOffset,
                   sequence->getStartPosition() + startOffset + length - 1,
-                  NULL, blocks);
+                  NULL, blocks, _dupeBlockArena);
 
 /*
     cerr << "map seqeunce " << sequence->getName() << endl;
@@ -378,20 +1809,24 @@ pair<SGSide, SGSide> SGBuilder::createSGSequence(const Sequence* sequence,
 
   // make a new Side Graph Sequence
   string name;
-  if (!_stripSequenceNames)
+  bool wholeSequence = length >= (hal_index_t)sequence->getSequenceLength();
+  if (!_stripSequenceNames && !_lazySequenceNames)
   {
-    stringstream ss;
-    ss << getHalSeqName(sequence);
-    if (length < (hal_index_t)sequence->getSequenceLength())
+    name = getHalSeqName(sequence);
+    if (!wholeSequence)
     {
-      ss << "_" << startOffset << "_" << newSeqLen;
+      SGSeqNames::appendRange(name, startOffset, newSeqLen);
     }
-    name = ss.str();
   }
   SGSequence* sgSeq = new SGSequence(-1, newSeqLen, name);
 
   // add to the Side Graph
   _sg->addSequence(sgSeq);
+  if (!_stripSequenceNames && _lazySequenceNames)
+  {
+    _seqNames.setOrigin(sgSeq->getID(), sequence,
+                        wholeSequence ? -1 : startOffset, newSeqLen);
+  }
 
   // update the _lookup structure for the entire new sequence
   // (gaps and uncollapsed regions)
@@ -437,9 +1872,8 @@ pair<SGSide, SGSide> SGBuilder::createSGSequence(const Sequence* sequence,
     {
       outHooks.second = blockHooks.second;
     }
-
-    delete blocks[i];
   }
+  _dupeBlockArena.reset();
     
   assert(outHooks.first.getBase() != SideGraph::NullPos);
   assert(outHooks.second.getBase() != SideGraph::NullPos);
@@ -462,7 +1896,9 @@ const SGJoin* SGBuilder::createSGJoin(const SGSide& side1, const SGSide& side2)
 void SGBuilder::mapSequence(const Sequence* sequence,
                             hal_index_t globalStart,
                             hal_index_t globalEnd,
-                            const Genome* target)
+                            const Genome* target,
+                            SequenceJob* job,
+                            MapPipeline* pipeline)
 {
   const Genome* genome = sequence->getGenome();
 
@@ -476,8 +1912,14 @@ void SGBuilder::mapSequence(const Sequence* sequence,
   }
   else 
   {
-    vector<Block*> blocks;
-    computeBlocks(sequence, globalStart, globalEnd, target, blocks);
+    // blocks (and their DNA) are owned by the job if it's given
+    vector<Block*> localBlocks;
+    if (job == NULL)
+    {
+      computeBlocks(sequence, globalStart, globalEnd, target, localBlocks,
+                    _blockArena);
+    }
+    vector<Block*>& blocks = job != NULL ? job->_blocks : localBlocks;
 
     SGSide prevHook(SideGraph::NullPos, true);
    
@@ -493,8 +1935,18 @@ void SGBuilder::mapSequence(const Sequence* sequence,
         Block* prev = i == 0 ? NULL : blocks[i-1];
         Block* next = i == blocks.size() - 1 ? NULL : blocks[i+1];
         Block* block = blocks[i];
-        visitBlock(prev, block, next, prevHook, sequence,
-                   genome, sequenceStart, sequenceEnd, target);
+        if (job != NULL)
+        {
+          pipeline->waitForDNA(*job, i);
+          visitBlock(prev, block, next, prevHook, sequence,
+                     genome, sequenceStart, sequenceEnd, target,
+                     &job->_srcDNA[i], &job->_tgtDNA[i]);
+        }
+        else
+        {
+          visitBlock(prev, block, next, prevHook, sequence,
+                     genome, sequenceStart, sequenceEnd, target);
+        }
       }
       // add insert at end / last step in path
       visitBlock(blocks.back(), NULL, NULL, prevHook, sequence,
@@ -506,10 +1958,7 @@ void SGBuilder::mapSequence(const Sequence* sequence,
       visitBlock(NULL, NULL, NULL, prevHook, sequence,
                  genome, sequenceStart, sequenceEnd, target);
     }
-    for (size_t j = 0; j < blocks.size(); ++j)
-    {
-      delete blocks[j];
-    }
+    _blockArena.reset();
   }
 }
 
@@ -517,8 +1966,25 @@ void SGBuilder::computeBlocks(const Sequence* sequence,
                               hal_index_t globalStart,
                               hal_index_t globalEnd,
                               const Genome* target,
-                              vector<Block*>& blocks)
+                              vector<Block*>& blocks,
+                              BlockArena& arena,
+                              size_t reader)
 {
+  const set<const Genome*>* mapPath = &_mapPath;
+  const Genome* mapRoot = _mapRoot;
+  const Genome* mapMrca = _mapMrca;
+  if (reader > 0)
+  {
+    // switch everything over to the reader's handle
+    sequence = _readerPool.getSequence(sequence, reader);
+    if (target != NULL)
+    {
+      target = _readerPool.getGenome(target, reader);
+    }
+    mapPath = &_readerMapPaths[reader];
+    mapRoot = _readerPool.getGenome(mapRoot, reader);
+    mapMrca = _readerPool.getGenome(mapMrca, reader);
+  }
   const Genome* genome = sequence->getGenome();
 
   if (target == NULL)
@@ -558,7 +2024,8 @@ void SGBuilder::computeBlocks(const Sequence* sequence,
   while (refSeg->getArrayIndex() < lastIndex &&
          refSeg->getStartPosition() <= globalEnd)  
   {
-    halMapSegment(refSeg.get(), mappedSegments, target, &_mapPath, true, 0, _mapRoot, _mapMrca);
+    halMapSegment(refSeg.get(), mappedSegments, target, mapPath, true, 0,
+                  mapRoot, mapMrca);
     
     refSeg->toRight(globalEnd);
   }
@@ -575,17 +2042,13 @@ void SGBuilder::computeBlocks(const Sequence* sequence,
   {
     BlockMapper::extractSegment(i, emptySet, fragments, &mappedSegments, 
                                 targetCutSet, queryCutSet);
-    Block* block = new Block();
+    Block* block = arena.allocate();
     fragmentsToBlock(fragments, *block);
-    // filter trivial self alignments while at it
-    if (block->_srcSeq == block->_tgtSeq &&
-        block->_srcStart == block->_tgtStart &&
-        block->_srcEnd == block->_tgtEnd)
-    {
-      delete block;
-      block = NULL;
-    }
-    else
+    // filter trivial self alignments while at it (leaving them in the
+    // arena)
+    if (block->_srcSeq != block->_tgtSeq ||
+        block->_srcStart != block->_tgtStart ||
+        block->_srcEnd != block->_tgtEnd)
     {
       blocks.push_back(block);
     }
@@ -594,7 +2057,183 @@ void SGBuilder::computeBlocks(const Sequence* sequence,
   // do clipping to make sure no overlaps
   // (but leave exact overlaps if self alignment)
   // This also sorts blocks on SRC which is extremely important
-  cutBlocks(blocks, target == genome);
+  cutBlocks(blocks, arena, target == genome);
+
+  if (reader > 0)
+  {
+    // blocks always returned in terms of _alignment
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      blocks[i]->_srcSeq = _readerPool.getMainSequence(blocks[i]->_srcSeq);
+      blocks[i]->_tgtSeq = _readerPool.getMainSequence(blocks[i]->_tgtSeq);
+    }
+  }
+}
+
+void SGBuilder::getBlockDNA(const Block* block, string& outSrcDNA,
+                            string& outTgtDNA, size_t reader) const
+{
+  hal_index_t length = block->_srcEnd - block->_srcStart + 1;
+  readDNA(block->_srcSeq, block->_srcStart, length, outSrcDNA, reader);
+  readDNA(block->_tgtSeq, block->_tgtStart, length, outTgtDNA, reader);
+}
+
+void SGBuilder::readDNA(const Sequence* sequence, hal_index_t pos,
+                        hal_index_t length, string& outDNA, 
+                        size_t reader) const
+{
+  PackedGenomeMap::const_iterator pgi = _packedGenomes.find(
+    sequence->getGenome());
+  if (pgi != _packedGenomes.end())
+  {
+    pgi->second[sequence->getArrayIndex()].getSubString(outDNA, pos, length);
+  }
+  else
+  {
+    _dnaCache.getSubString(sequence, 
+                           _readerPool.getSequence(sequence, reader),
+                           pos, length, outDNA);
+  }
+}
+
+void SGBuilder::prefetchSequenceDNA()
+{
+  vector<DNAPiece> pieces;
+  map<sg_int_t, string> sequenceDNA;
+  vector<SGSegment> segPath;
+  vector<const Sequence*> halSeqPath;
+  // only fetch what will fit in the store
+  size_t numBytes = _sgDNA.getNumBytes();
+  for (sg_int_t i = 0; i < _sg->getNumSequences(); ++i)
+  {
+    const SGSequence* sgSeq = _sg->getSequence(i);
+    if (sgSeq->getLength() > PrefetchMaxLength ||
+        _sgDNA.get(i, sgSeq->getLength()) != NULL)
+    {
+      continue;
+    }
+    numBytes += PackedDNA::getNumBytes(sgSeq->getLength());
+    if (numBytes > _sgDNA.getMaxBytes())
+    {
+      break;
+    }
+    _lookBack.getPath(SGPosition(i, 0), sgSeq->getLength(), true,
+                      segPath, halSeqPath);
+    sg_int_t offset = 0;
+    for (size_t j = 0; j < segPath.size(); ++j)
+    {
+      DNAPiece piece;
+      piece._halSequence = halSeqPath[j];
+      piece._halStart = segPath[j].getMinPos().getPos();
+      piece._length = segPath[j].getLength();
+      piece._forward = segPath[j].getSide().getForward();
+      piece._sgSeqID = i;
+      piece._offset = offset;
+      pieces.push_back(piece);
+      offset += segPath[j].getLength();
+    }
+    assert(offset == sgSeq->getLength());
+    sequenceDNA[i].resize(sgSeq->getLength());
+  }
+
+  sort(pieces.begin(), pieces.end());
+  string window;
+  string buffer;
+  for (size_t i = 0; i < pieces.size();)
+  {
+    // one read for all following pieces within PrefetchWindowSize
+    const Sequence* halSeq = pieces[i]._halSequence;
+    hal_index_t windowStart = pieces[i]._halStart;
+    hal_index_t windowEnd = windowStart + pieces[i]._length;
+    size_t j = i + 1;
+    for (; j < pieces.size() && pieces[j]._halSequence == halSeq &&
+           pieces[j]._halStart + pieces[j]._length - windowStart <= 
+           PrefetchWindowSize; ++j)
+    {
+      windowEnd = max(windowEnd, pieces[j]._halStart + pieces[j]._length);
+    }
+    getHalDNA(halSeq, windowStart, windowEnd - windowStart, window, 0);
+    for (; i < j; ++i)
+    {
+      const DNAPiece& piece = pieces[i];
+      buffer = window.substr(piece._halStart - windowStart, piece._length);
+      if (piece._forward == false)
+      {
+        reverseComplementDNA(buffer);
+      }
+      sequenceDNA[piece._sgSeqID].replace(piece._offset, piece._length, 
+                                          buffer);
+    }
+  }
+
+  for (map<sg_int_t, string>::const_iterator i = sequenceDNA.begin();
+       i != sequenceDNA.end(); ++i)
+  {
+    _sgDNA.add(i->first, i->second);
+  }
+}
+
+bool SGBuilder::DNAPiece::operator<(const DNAPiece& other) const
+{
+  if (_halSequence != other._halSequence)
+  {
+    return less<const Sequence*>()(_halSequence, other._halSequence);
+  }
+  return _halStart < other._halStart;
+}
+
+void SGBuilder::preloadGenome(const Genome* genome)
+{
+  if (_packedGenomes.find(genome) != _packedGenomes.end() ||
+      (_camelMode == true && genome->getParent() == NULL))
+  {
+    return;
+  }
+  if (_preloadBytes + PackedDNA::getNumBytes(genome->getSequenceLength()) >
+      _maxPreloadBytes)
+  {
+    return;
+  }
+  vector<PackedDNA>& packedSequences = _packedGenomes[genome];
+  packedSequences.resize(genome->getNumSequences());
+  string buffer;
+  SequenceIteratorPtr si = genome->getSequenceIterator();
+  for (size_t i = 0; i < genome->getNumSequences(); ++i, si->toNext())
+  {
+    const Sequence* sequence = si->getSequence();
+    PackedDNA& packedDNA = packedSequences[sequence->getArrayIndex()];
+    hal_index_t length = sequence->getSequenceLength();
+    // read in chunks to keep the buffer small
+    for (hal_index_t pos = 0; pos < length; pos += PreloadChunkSize)
+    {
+      sequence->getSubString(buffer, pos, min(PreloadChunkSize, 
+                                              length - pos));
+      packedDNA.append(buffer);
+    }
+    _preloadBytes += packedDNA.getNumBytes();
+  }
+}
+
+void SGBuilder::prepareReaders(const Genome* genome, const Genome* target)
+{
+  _readerPool.openGenome(genome);
+  _readerPool.openGenome(target);
+  _readerPool.openGenome(_mapRoot);
+  _readerPool.openGenome(_mapMrca);
+  _readerMapPaths.resize(_readerPool.getNumReaders());
+  for (size_t i = 1; i < _readerMapPaths.size(); ++i)
+  {
+    _readerMapPaths[i].clear();
+  }
+  for (set<const Genome*>::const_iterator j = _mapPath.begin();
+       j != _mapPath.end(); ++j)
+  {
+    _readerPool.openGenome(*j);
+    for (size_t i = 1; i < _readerMapPaths.size(); ++i)
+    {
+      _readerMapPaths[i].insert(_readerPool.getGenome(*j, i));
+    }
+  }
 }
 
 void SGBuilder::visitBlock(Block* prevBlock,
@@ -605,7 +2244,9 @@ void SGBuilder::visitBlock(Block* prevBlock,
                            const Genome* srcGenome,
                            hal_index_t sequenceStart,
                            hal_index_t sequenceEnd,
-                           const Genome* tgtGenome)
+                           const Genome* tgtGenome,
+                           const string* srcDNA,
+                           const string* tgtDNA)
 {
   hal_index_t prevSrcPos;  // global hal coord of end of last block
   hal_index_t srcPos;  // global hal coord of beginning of block
@@ -649,12 +2290,14 @@ void SGBuilder::visitBlock(Block* prevBlock,
   }
   if (block != NULL)
   {
-    pair<SGSide, SGSide> blockHooks = mapBlockEnds(block);
+    pair<SGSide, SGSide> blockHooks = mapBlockEnds(block, srcDNA, tgtDNA);
     prevHook = blockHooks.second;
   }
 }
 
-pair<SGSide, SGSide> SGBuilder::mapBlockEnds(const Block* block)
+pair<SGSide, SGSide> SGBuilder::mapBlockEnds(const Block* block,
+                                             const string* srcDNA,
+                                             const string* tgtDNA)
 {
   assert(block != NULL);
   
@@ -731,7 +2374,20 @@ pair<SGSide, SGSide> SGBuilder::mapBlockEnds(const Block* block)
     // we need to map the inside of the block.  this means processing
     // all the snps, as well as making sure the lookup structure is
     // updated.
-    pair<SGSide, SGSide> mappedBlockEnds =  mapBlockBody(&blockSeg, blockEnds);
+    pair<SGSide, SGSide> mappedBlockEnds;
+    if (srcDNA == NULL || ludist + 1 == blockLength)
+    {
+      mappedBlockEnds = mapBlockBody(&blockSeg, blockEnds, srcDNA, tgtDNA);
+    }
+    else
+    {
+      // pass on the part of the (pre-read) dna covered by blockSeg
+      string srcSegDNA = srcDNA->substr(covered, ludist + 1);
+      string tgtSegDNA = tgtDNA->substr(
+        blockSeg._tgtStart - block->_tgtStart, ludist + 1);
+      mappedBlockEnds = mapBlockBody(&blockSeg, blockEnds, &srcSegDNA,
+                                     &tgtSegDNA);
+    }
     if (covered == 0)
     {
       outBlockEnds.first = mappedBlockEnds.first;
@@ -751,63 +2407,72 @@ pair<SGSide, SGSide> SGBuilder::mapBlockEnds(const Block* block)
 
 pair<SGSide, SGSide>
 SGBuilder::mapBlockBody(const Block* block,
-                        const pair<SGSide, SGSide>& sgBlockEnds)
+                        const pair<SGSide, SGSide>& sgBlockEnds,
+                        const string* srcDNAIn,
+                        const string* tgtDNAIn)
 {
   // note to self:  block is the pairwise HAL alignment
   //                sgBlockEnds are the endpoints in the Side Graph
   hal_index_t length = block->_srcEnd - block->_srcStart + 1;
-  string srcDNA;
-  string tgtDNA;
-  block->_srcSeq->getSubString(srcDNA, block->_srcStart, length);
-  block->_tgtSeq->getSubString(tgtDNA, block->_tgtStart, length);
+  string srcBuffer;
+  string tgtBuffer;
+  if (srcDNAIn == NULL)
+  {
+    getBlockDNA(block, srcBuffer, tgtBuffer);
+    srcDNAIn = &srcBuffer;
+    tgtDNAIn = &tgtBuffer;
+  }
+  const string& srcDNA = *srcDNAIn;
+  const string& tgtDNA = *tgtDNAIn;
+  assert((hal_index_t)srcDNA.length() == length);
+  assert((hal_index_t)tgtDNA.length() == length);
   pair<SGSide, SGSide> outBlockEnds = sgBlockEnds;
 
-  SGSide prevHook(sgBlockEnds.first);
-  bool runningSnp = false;
-
-  hal_index_t srcPos;
-  char srcVal;
-  char tgtVal;
-  hal_index_t bp = 0;
+  // find the runs of consecutive SNPs (no SNPs in camel mode)
+  vector<DNAMismatchRun> snpRuns;
+  if (!_camelMode)
+  {
+    findDNAMismatchRuns(srcDNA, tgtDNA, block->_reversed,
+                        _snpHandler->isCaseSensitive(), snpRuns);
+  }
 
   // slice block into runs of consecutive SNPs and the regions in between
   // ex:  AACGTATAC
   //      ACCGTGGAG
   // would translate to 5 slices: 123334455
-  for (hal_index_t i = 0; i < length; ++i)
+  hal_index_t bp = 0;
+  for (size_t i = 0; i <= snpRuns.size(); ++i)
   {
-    srcPos =  block->_srcStart + i;
-    srcVal = srcDNA[i];
-    tgtVal = !block->_reversed ? tgtDNA[i] :
-       reverseComplement(tgtDNA[length - 1 - i]);
-    bool snp = !_camelMode && _snpHandler->isSub(srcVal, tgtVal);
-
-    if (i > 0 && snp != runningSnp)
+    hal_index_t runStart = i < snpRuns.size() ? 
+       (hal_index_t)snpRuns[i]._start : length;
+    // slice of matches before the run
+    if (runStart > bp)
     {
       pair<SGSide, SGSide> sliceEnds = mapBlockSlice(block, sgBlockEnds,
-                                                     bp, i - 1,
-                                                     runningSnp,
+                                                     bp, runStart - 1,
+                                                     false,
                                                      srcDNA, tgtDNA);
       if (bp == 0)
       {
         outBlockEnds.first = sliceEnds.first;
       }
-      prevHook = sliceEnds.second;
-      bp = i;
+      outBlockEnds.second = sliceEnds.second;
     }
-    if (i == length - 1)
+    // the run itself
+    if (i < snpRuns.size())
     {
-      pair<SGSide, SGSide> sliceEnds = mapBlockSlice(block, sgBlockEnds, bp, i,
-                                                     snp,srcDNA, tgtDNA);
-      if (bp == 0)
+      hal_index_t runEnd = runStart + (hal_index_t)snpRuns[i]._length - 1;
+      pair<SGSide, SGSide> sliceEnds = mapBlockSlice(block, sgBlockEnds,
+                                                     runStart, runEnd,
+                                                     true,
+                                                     srcDNA, tgtDNA);
+      if (runStart == 0)
       {
         outBlockEnds.first = sliceEnds.first;
       }
       outBlockEnds.second = sliceEnds.second;
-      prevHook = sliceEnds.second;
+      bp = runEnd + 1;
     }
-    
-    runningSnp = snp;
   }
 
   return outBlockEnds;
@@ -868,6 +2533,7 @@ SGBuilder::mapBlockSlice(const Block* block,
   }
   else
   {
+    _snpSequences.resize(_sg->getNumSequences(), false);
     outEnds = _snpHandler->createSNP(srcDNA,
                                      tgtDNA,
                                      srcStartOffset,
@@ -879,6 +2545,8 @@ SGBuilder::mapBlockSlice(const Block* block,
                                      !sgForwardMap,
                                      _lookup,
                                      &_lookBack);
+    // any new sequences are snps
+    _snpSequences.resize(_sg->getNumSequences(), true);
   }
 
   return outEnds;
@@ -924,42 +2592,57 @@ void SGBuilder::fragmentsToBlock(const vector<MappedSegmentPtr>& fragments,
   block._reversed = srcFront->getReversed() != fragments.front()->getReversed();
 }
 
-void SGBuilder::cutBlocks(vector<Block*>& blocks, bool leaveExactOverlaps)
+void SGBuilder::cutBlocks(vector<Block*>& blocks, BlockArena& arena,
+                          bool leaveExactOverlaps)
 {
-  set<hal_index_t> cutPoints;
+  // flat sorted array instead of a set since it's only ever searched
+  // after being built.
+  vector<hal_index_t> cutPoints;
+  cutPoints.reserve(4 * blocks.size() + 1);
   for (size_t i = 0; i < blocks.size(); ++i)
   {
-    cutPoints.insert(blocks[i]->_srcStart);
+    cutPoints.push_back(blocks[i]->_srcStart);
     // by convention we will let cutPoints be all
     // valid starting points for blocks (why we add one here). 
-    cutPoints.insert(blocks[i]->_srcEnd + 1);
+    cutPoints.push_back(blocks[i]->_srcEnd + 1);
     if (blocks[i]->_srcSeq == blocks[i]->_tgtSeq)
     {
-      cutPoints.insert(blocks[i]->_tgtStart);
-      cutPoints.insert(blocks[i]->_tgtEnd + 1);      
+      cutPoints.push_back(blocks[i]->_tgtStart);
+      cutPoints.push_back(blocks[i]->_tgtEnd + 1);      
     }
   }
-  cutPoints.insert(numeric_limits<hal_index_t>::max());
+  cutPoints.push_back(numeric_limits<hal_index_t>::max());
+  sort(cutPoints.begin(), cutPoints.end());
+  cutPoints.erase(unique(cutPoints.begin(), cutPoints.end()), cutPoints.end());
+  
   vector<Block*> outBlocks;
+  outBlocks.reserve(blocks.size());
+  // index of each output block's start in cutPoints
+  vector<size_t> startRanks;
+  startRanks.reserve(blocks.size());
 
   for (size_t i = 0; i < blocks.size(); ++i)
   {
-    set<hal_index_t>::iterator j = cutPoints.upper_bound(blocks[i]->_srcStart);
+    vector<hal_index_t>::const_iterator j = upper_bound(
+      cutPoints.begin(), cutPoints.end(), blocks[i]->_srcStart);
+    size_t startRank = j - cutPoints.begin() - 1;
+    assert(cutPoints[startRank] == blocks[i]->_srcStart);
     // not cut
     if (*j > blocks[i]->_srcEnd)
     {
       outBlocks.push_back(blocks[i]);
+      startRanks.push_back(startRank);
     }
-    // cut
+    // cut: sweep along the cut points inside the block
     else
     {
       hal_index_t prev = blocks[i]->_srcStart;
       hal_index_t curLen = 0;
       hal_index_t blockLen = blocks[i]->_srcEnd - blocks[i]->_srcStart + 1;
-      for (set<hal_index_t>::iterator k = j; curLen < blockLen; ++k)
+      for (vector<hal_index_t>::const_iterator k = j; curLen < blockLen; ++k)
       {
         hal_index_t pos = min(*k, blocks[i]->_srcEnd + 1);
-        Block* block = new Block();
+        Block* block = arena.allocate();
         block->_srcSeq = blocks[i]->_srcSeq;
         block->_tgtSeq = blocks[i]->_tgtSeq;
         block->_srcStart = prev;
@@ -979,26 +2662,63 @@ void SGBuilder::cutBlocks(vector<Block*>& blocks, bool leaveExactOverlaps)
         curLen += thisLen;
         assert(block->_srcEnd - block->_srcStart  ==
                block->_tgtEnd - block->_tgtStart);
-        assert(cutPoints.find(block->_srcStart) != cutPoints.end());
-        assert(cutPoints.find(block->_srcEnd + 1) != cutPoints.end());
-        /*
-        for (hal_index_t temp = block->_srcStart + 1; temp <= block->_srcEnd;
-             ++temp)
-        {
-          assert(cutPoints.find(temp) == cutPoints.end());
-        }
-        */
+        // (both ends are cut points by construction since we walk the
+        // array from the block's start)
         prev = block->_srcEnd + 1;
         outBlocks.push_back(block);
+        startRanks.push_back(startRank);
+        startRank = k - cutPoints.begin();
       }
       (void)blockLen;
       assert(blockLen == curLen);
-      delete blocks[i];
     }
   }
 
-  // sort the clipped blocks based on src coordinates. 
-  sort(outBlocks.begin(), outBlocks.end(), BlockPtrLess());
+  // sort the clipped blocks based on src coordinates.  every block
+  // starts on a cut point, so we can bucket them on its rank (counting
+  // sort) and only need to compare the (flat) keys of blocks with
+  // the same start.  ties keep their original order.
+  vector<size_t> bucketStarts(cutPoints.size() + 1, 0);
+  for (size_t i = 0; i < startRanks.size(); ++i)
+  {
+    ++bucketStarts[startRanks[i] + 1];
+  }
+  for (size_t i = 1; i < bucketStarts.size(); ++i)
+  {
+    bucketStarts[i] += bucketStarts[i - 1];
+  }
+  vector<BlockKey> keys(outBlocks.size());
+  for (size_t i = 0; i < outBlocks.size(); ++i)
+  {
+    assert(outBlocks[i]->_srcSeq == outBlocks[0]->_srcSeq);
+    BlockKey& key = keys[bucketStarts[startRanks[i]]++];
+    key._srcStart = outBlocks[i]->_srcStart;
+    key._srcEnd = outBlocks[i]->_srcEnd;
+    key._tgtStart = outBlocks[i]->_tgtStart;
+    key._tgtEnd = outBlocks[i]->_tgtEnd;
+    key._index = i;
+  }
+  vector<size_t>().swap(startRanks);
+  vector<size_t>().swap(bucketStarts);
+  for (size_t i = 0; i < keys.size();)
+  {
+    size_t last = i + 1;
+    while (last < keys.size() && keys[last]._srcStart == keys[i]._srcStart)
+    {
+      ++last;
+    }
+    if (last - i > 1)
+    {
+      sort(keys.begin() + i, keys.begin() + last);
+    }
+    i = last;
+  }
+  vector<Block*> sortedBlocks(outBlocks.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    sortedBlocks[i] = outBlocks[keys[i]._index];
+  }
+  swap(sortedBlocks, outBlocks);
 
   if (leaveExactOverlaps == true)
   {
@@ -1017,7 +2737,6 @@ void SGBuilder::cutBlocks(vector<Block*>& blocks, bool leaveExactOverlaps)
       else
       {
         assert(blocks.back()->_srcEnd == outBlocks[i]->_srcEnd);
-        delete outBlocks[i];
       }
     }
   }
@@ -1053,119 +2772,218 @@ void SGBuilder::cutBlocks(vector<Block*>& blocks, bool leaveExactOverlaps)
 }
 
 void SGBuilder::addPathJoins(const Sequence* sequence,
-                             const vector<SGSegment>& path)
+                             const vector<SGSegment>& path,
+                             vector<pair<SGSide, SGSide> >* outJoins,
+                             size_t reader)
 {
-  string pathString;
-  string buffer;
-  for (size_t i = 0; i < path.size(); ++i)
+  for (size_t i = 1; i < path.size(); ++i)
   {
-    const SGSegment& seg = path[i];
-    const SGSequence* seq = _sg->getSequence(
-      seg.getSide().getBase().getSeqID());
-    assert(seg.getMaxPos().getPos() < seq->getLength());
-    assert(seg.getMinPos().getPos() >= 0);
-    getSequenceString(seq, buffer, seg.getMinPos().getPos(), seg.getLength());
-    if (seg.getSide().getForward() == false)
+    SGSide srcSide = path[i-1].getOutSide();
+    SGSide tgtSide = path[i].getInSide();
+    if (outJoins != NULL)
     {
-      reverseComplement(buffer);
+      outJoins->push_back(pair<SGSide, SGSide>(srcSide, tgtSide));
     }
-    pathString.append(buffer);
-    if (i > 0)
+    else
     {
-      SGSide srcSide = path[i-1].getOutSide();
-      SGSide tgtSide = seg.getInSide();
       createSGJoin(srcSide, tgtSide);
     }
   }
 
-  if (_camelMode == true && sequence->getGenome()->getParent() == NULL)
-  {
-    getRootSubString(buffer, sequence, 0, sequence->getSequenceLength());
-  }
-  else
+  verifyPath(sequence, path, reader);
+}
+
+void SGBuilder::verifyPath(const Sequence* sequence,
+                           const vector<SGSegment>& path,
+                           size_t reader) const
+{
+  if (_verifyLevel == VerifyOff)
   {
-    sequence->getString(buffer);
+    return;
   }
-  transform(buffer.begin(), buffer.end(), buffer.begin(), ::toupper);
-  transform(pathString.begin(), pathString.end(), pathString.begin(),::toupper);
-
-  if (buffer != pathString)
+  
+  hal_index_t halPos = 0;
+  for (size_t i = 0; i < path.size(); ++i)
   {
-    cerr << getHalSeqName(sequence) << endl;
-    cerr << "BUF " << buffer.length()   << endl;
-    cerr << "PAT " << pathString.length()  << endl;
-
-/*    cerr << "BUF " << buffer   << endl;
-    cerr << "PAT " << pathString  << endl;
-    cerr <<"    ";
-    for (size_t x = 0; x < buffer.length() ; ++x)
+    const SGSegment& seg = path[i];
+    sg_int_t seqID = seg.getSide().getBase().getSeqID();
+    if (seqID < 0 || seqID >= _sg->getNumSequences() ||
+        seg.getMinPos().getPos() < 0 || 
+        seg.getMaxPos().getPos() >= _sg->getSequence(seqID)->getLength())
     {
-      if (buffer[x] != pathString[x]) cerr << "^";
-      else cerr <<" ";
+      stringstream ss;
+      ss << "Consistency check failed: Output path for sequence \""
+         << sequence->getFullName() << "\" leaves the Side Graph at " 
+         << seg.getSide() << " (length " << seg.getLength() 
+         << "). This likely due to a bug. Please report it!";
+      throw hal_exception(ss.str());
     }
-    cerr << endl;
-    cerr <<"    ";
-    for (size_t x = 0; x < buffer.length() ; ++x)
+    if (_verifyLevel == VerifySampled)
     {
-      if (buffer[x] != pathString[x]) {cerr << x;break;}
-      else cerr <<" ";
+      // only check the chunks (of the HAL sequence) that are sampled
+      hal_index_t segEnd = min(halPos + (hal_index_t)seg.getLength(), 
+                               (hal_index_t)sequence->getSequenceLength());
+      for (hal_index_t pos = halPos; pos < segEnd;)
+      {
+        hal_index_t chunk = pos / VerifyChunkSize;
+        hal_index_t end = min((chunk + 1) * VerifyChunkSize, segEnd);
+        if (chunk % VerifySampleRate == 0)
+        {
+          verifySegmentDNA(sequence, halPos, seg, pos - halPos, end - pos,
+                           reader);
+        }
+        pos = end;
+      }
     }
-    cerr << endl;
-*/
-    size_t numDiffs = 0;
-    for (size_t x = 0; x < buffer.length(); ++x)
+    else
     {
-      if (buffer[x] != pathString[x])
+      verifySegmentStructure(sequence, halPos, seg, reader);
+      // the structural check already compared the DNA of SNP sequences
+      if (_verifyLevel == VerifyFull && isSNPSequence(seqID) == false)
       {
-        ++numDiffs;
-        if (numDiffs < 5)
-        cerr << x << " " << buffer[x] << "->" << pathString[x] << endl;
+        verifySegmentDNA(sequence, halPos, seg, 0, seg.getLength(), reader);
       }
     }
-    cerr << "total diffs " << numDiffs << " / " << buffer.length() << endl;
-    cerr << endl;
+    halPos += seg.getLength();
+  }
+  
+  if (halPos != sequence->getSequenceLength())
+  {
     stringstream ss;
     ss << "Consistency check failed: Output path for sequence \""
-       << sequence->getFullName() << "\" does not match input"
-       << " HAL sequence. This likely due to a bug. Please report it!";
+       << sequence->getFullName() << "\" has length " << halPos 
+       << " instead of " << sequence->getSequenceLength()
+       << ". This likely due to a bug. Please report it!";
     throw hal_exception(ss.str());
-    
   }
 }
 
-
-void SGBuilder::getRootSubString(string& outDNA, const Sequence* sequence,
-                                 hal_index_t pos, hal_index_t length) const
+void SGBuilder::verifySegmentDNA(const Sequence* sequence, hal_index_t halPos,
+                                 const SGSegment& seg, sg_int_t offset,
+                                 sg_int_t length, size_t reader) const
 {
+  assert(offset >= 0 && offset + length <= seg.getLength());
+  const SGSequence* sgSeq = _sg->getSequence(
+    seg.getSide().getBase().getSeqID());
+  bool forward = seg.getSide().getForward();
+  string pathString;
   string buffer;
-  outDNA.erase();
-  // copy the DNA sequence up from the children for the entire genome. 
-  if (_rootString.length() == 0)
+  for (sg_int_t done = 0; done < length; done += VerifyChunkSize)
   {
-    const Genome* root = sequence->getGenome();
-    assert (root->getParent() == NULL);
-    BottomSegmentIteratorPtr bottom = root->getBottomSegmentIterator();
-    TopSegmentIteratorPtr top = root->getChild(0)->getTopSegmentIterator();
-    for (size_t i = 0 ; i < root->getNumBottomSegments(); ++i)
+    sg_int_t chunk = min(length - done, VerifyChunkSize);
+    // offset in path order, so flip if the segment is reversed
+    sg_int_t segOffset = offset + done;
+    sg_int_t sgPos = seg.getMinPos().getPos() + (forward ? segOffset :
+                                                 seg.getLength() - 
+                                                 segOffset - chunk);
+    getSequenceString(sgSeq, pathString, sgPos, chunk, reader);
+    if (forward == false)
+    {
+      reverseComplementDNA(pathString);
+    }
+    hal_index_t chunkPos = halPos + segOffset;
+    if (chunkPos + chunk > sequence->getSequenceLength())
+    {
+      // let the length check in verifyPath() complain
+      return;
+    }
+    getHalDNA(sequence, chunkPos, chunk, buffer, reader);
+    assert(buffer.length() == pathString.length());
+    
+    size_t numDiffs = 0;
+    for (size_t x = 0; x < buffer.length(); ++x)
     {
-      for (size_t j = 0; j < root->getNumChildren(); ++j)
+      if (toupper(buffer[x]) != toupper(pathString[x]))
       {
-        if (bottom->getBottomSegment()->hasChild(j))
+        ++numDiffs;
+        if (numDiffs < 5)
         {
-          top->toChild(bottom, j);
-          top->getString(buffer);
-          _rootString.append(buffer);
-          break;
+          cerr << (chunkPos + x) << " " << buffer[x] << "->" 
+               << pathString[x] << endl;
         }
-        assert(j != root->getNumChildren() - 1);
       }
-      bottom->toRight();
     }
-    assert(root->getSequenceLength() == _rootString.length());
+    if (numDiffs > 0)
+    {
+      cerr << getHalSeqName(sequence) << endl;
+      cerr << "total diffs " << numDiffs << " / " << buffer.length() 
+           << " at " << chunkPos << endl;
+      cerr << endl;
+      stringstream ss;
+      ss << "Consistency check failed: Output path for sequence \""
+         << sequence->getFullName() << "\" does not match input"
+         << " HAL sequence. This likely due to a bug. Please report it!";
+      throw hal_exception(ss.str());
+    }
+  }
+}
+
+void SGBuilder::verifySegmentStructure(const Sequence* sequence,
+                                       hal_index_t halPos,
+                                       const SGSegment& seg,
+                                       size_t reader) const
+{
+  sg_int_t seqID = seg.getSide().getBase().getSeqID();
+  vector<SGSegment> segPath;
+  vector<const Sequence*> halSeqPath;
+  _lookBack.getPath(SGPosition(seqID, seg.getMinPos().getPos()),
+                    seg.getLength(), true, segPath, halSeqPath);
+  bool snp = isSNPSequence(seqID);
+  sg_int_t sgOffset = 0;
+  for (size_t i = 0; i < segPath.size(); ++i)
+  {
+    const SGSegment& halSeg = segPath[i];
+    if (halSeqPath[i] == NULL || halSeg.getMinPos().getPos() < 0 ||
+        halSeg.getMaxPos().getPos() >= 
+        (sg_int_t)halSeqPath[i]->getSequenceLength())
+    {
+      break;
+    }
+    if (snp == true)
+    {
+      // offset in path order, so flip if the segment is reversed
+      sg_int_t segOffset = seg.getSide().getForward() ? sgOffset :
+         seg.getLength() - sgOffset - halSeg.getLength();
+      verifySegmentDNA(sequence, halPos, seg, segOffset, halSeg.getLength(),
+                       reader);
+    }
+    sgOffset += halSeg.getLength();
+  }
+
+  if (sgOffset != seg.getLength())
+  {
+    stringstream ss;
+    ss << "Consistency check failed: Output path for sequence \""
+       << sequence->getFullName() << "\" uses bases at " << seg.getSide()
+       << " (length " << seg.getLength() << ") that do not come from HAL"
+       << ". This likely due to a bug. Please report it!";
+    throw hal_exception(ss.str());
+  }
+}
+
+void SGBuilder::getHalDNA(const Sequence* sequence, hal_index_t pos,
+                          hal_index_t length, string& outDNA,
+                          size_t reader) const
+{
+  if (_camelMode == true && sequence->getGenome()->getParent() == NULL)
+  {
+    getRootSubString(outDNA, sequence, pos, length, reader);
+  }
+  else
+  {
+    readDNA(sequence, pos, length, outDNA, reader);
   }
+}
+
 
-  // do our query on this new root.
-  outDNA = _rootString.substr(sequence->getStartPosition() + pos, length);
+void SGBuilder::getRootSubString(string& outDNA, const Sequence* sequence,
+                                 hal_index_t pos, hal_index_t length,
+                                 size_t reader) const
+{
+  assert(sequence->getGenome()->getParent() == NULL);
+  _rootDNACache.getSubString(sequence, 
+                             _readerPool.getSequence(sequence, reader),
+                             pos, length, outDNA);
 }
 
 void SGBuilder::getCollapsedFlags(const vector<Block*>& blocks,
@@ -1335,7 +3153,8 @@ void SGBuilder::filterRedundantDupeBlocks(vector<Block*>& blocks,
   // source. 
   set<SGPosition> srcVisited;
 
-  // this will be our output block list
+  // this will be our output block list (blocks that are filtered
+  // out are left in the arena)
   vector<Block*> filteredBlocks;
   
   for (size_t i = 0; i < blocks.size(); ++i)
@@ -1345,7 +3164,6 @@ void SGBuilder::filterRedundantDupeBlocks(vector<Block*>& blocks,
     SGPosition srcPos((sg_int_t)blocks[i]->_srcSeq->getArrayIndex(),
                       blocks[i]->_srcStart);
 
-    bool reused = false;
     if (srcVisited.find(srcPos) == srcVisited.end())
     {
       SGSide mapSide = collapseMap.mapPosition(srcPos);
@@ -1377,15 +3195,10 @@ void SGBuilder::filterRedundantDupeBlocks(vector<Block*>& blocks,
         if (luSide.getBase() != SideGraph::NullPos)
         {
           filteredBlocks.push_back(block);
-          reused = true;
           srcVisited.insert(srcPos);
         }
       }
     }
-    if (!reused)
-    {
-      delete block;
-    }
   }
   swap(filteredBlocks, blocks);
 }
@@ -11,6 +11,14 @@
 #include "sidegraph.h"
 #include "sglookup.h"
 #include "sglookback.h"
+#include "sgthreadpool.h"
+#include "halreaderpool.h"
+#include "genometreeindex.h"
+#include "dnacache.h"
+#include "packeddna.h"
+#include "lookupspill.h"
+#include "sgcheckpoint.h"
+#include "sgseqnames.h"
 
 class SNPHandler;
 
@@ -21,9 +29,48 @@ class SNPHandler;
 class SGBuilder
 {
 public:
+
+   /** Receives the path of each input sequence as computeJoins() 
+    * finds it, so that it doesn't need to be looked up again */
+   class PathSink
+   {
+   public:
+      virtual ~PathSink() {}
+      /** index is the position of sequence among those whose joins are 
+       * computed (in getHalSequences() order).  With more than one thread,
+       * this is called from all of them (threadIdx < getNumThreads()),
+       * in no particular order */
+      virtual void writePath(size_t index, size_t threadIdx,
+                             const hal::Sequence* sequence,
+                             const std::vector<SGSegment>& path) = 0;
+   };
+   
+   /** How thoroughly computeJoins() checks that the path of each input
+    * sequence spells out its DNA.  */
+   enum VerifyLevel 
+   {
+      // no check
+      VerifyOff,
+      // path length, and DNA of one in VerifySampleRate chunks
+      VerifySampled,
+      // every path base comes from a HAL interval (via the look back),
+      // and DNA of SNP sequences
+      VerifyStructural,
+      // structural, and all DNA
+      VerifyFull
+   };
+
+   static const sg_int_t VerifyChunkSize;
+   static const sg_int_t VerifySampleRate;
+   static const size_t DefaultDNACacheSize;
+   static const hal_index_t PreloadChunkSize;
+   static const sg_int_t PrefetchMaxLength;
+   static const hal_index_t PrefetchWindowSize;
+   static const hal_index_t CamelCheckChunkSize;
+   static const size_t LookupIntervalBytes;
    
    SGBuilder(); 
-   ~SGBuilder();
+   virtual ~SGBuilder();
 
    /** 
     * Set the alignment
@@ -33,6 +80,105 @@ public:
              bool onlySequenceNames = false,
              bool stripSeqNames = false);
 
+   /**
+    * CAMEL writes the root's DNA as Ns, which must then be inferred
+    * from its children (camelMode in init()).  Check if genome is all
+    * N, reading it CamelCheckChunkSize bases at a time and stopping at
+    * the first other base.
+    */
+   static bool isCamelGenome(const hal::Genome* genome);
+
+   /**
+    * Check if the root of the alignment is a CAMEL root (isCamelGenome())
+    * and turn on camelMode if so.  The check is only done once, and
+    * its result and (wall clock) time are kept.  Must be called after
+    * init() and before adding genomes.
+    */
+   bool detectCamelMode();
+   double getCamelCheckSeconds() const;
+
+   /**
+    * Map the sequences of each genome using numThreads threads.  The HAL
+    * API can't be shared across threads, so each extra thread opens its
+    * own handle to the file at halPath.  Output is identical to a 
+    * single-threaded run.  Must be called after init().  Only one
+    * thread is used if HDF5 wasn't built threadsafe.
+    */
+   void setNumThreads(size_t numThreads, const std::string& halPath = "",
+                      hal::CLParser* options = NULL);
+   size_t getNumThreads() const;
+
+   /**
+    * Set the path check done by computeJoins() (VerifyFull by default).
+    * DNA is compared VerifyChunkSize bases at a time, so memory doesn't
+    * grow with the sequence length.  Must be called after init().
+    */
+   void setVerifyLevel(VerifyLevel verifyLevel);
+   VerifyLevel getVerifyLevel() const;
+
+   /**
+    * Don't name side graph sequences as they are created, only remember
+    * the HAL range they come from.  They are then named all at once by
+    * nameSequences(), which the exporter calls before writing them.  
+    * Saves keeping a string for every (ie SNP) sequence through the 
+    * build.  sgExport reads the names straight from the sequences, so 
+    * they all exist during the export and its peak memory is the same.
+    * Must be called after init().
+    */
+   void setLazySequenceNames(bool lazy);
+
+   /** Name the sequences left unnamed by setLazySequenceNames() */
+   void nameSequences();
+
+   /**
+    * Set the size limit (in bytes) of the cache that DNA is read from HAL
+    * through (DefaultDNACacheSize by default, 0 to disable it).  In
+    * CAMEL mode, DNA inferred for the root is kept in a second cache 
+    * of the same size.
+    */
+   void setDNACacheSize(size_t maxBytes);
+   const DNACache& getDNACache() const;
+
+   /**
+    * Load the whole DNA of each genome that gets used as a mapping target
+    * into memory (2-bit packed), as long as the total stays (about) under
+    * maxBytes (0, the default, disables this).  Reads from these genomes
+    * then never go to HAL.
+    */
+   void setMaxPreloadBytes(size_t maxBytes);
+   size_t getPreloadBytes() const;
+   size_t getNumPreloadedGenomes() const;
+
+   /**
+    * Keep the DNA of Side Graph sequences in memory (2-bit packed), as 
+    * long as the total stays under maxBytes (0, the default, disables
+    * this).  Only DNA that's already in hand is stored:  that of SNP 
+    * sequences as they're created, and that of short sequences read by
+    * prefetchSequenceDNA().  The store counts towards setMaxMemory().
+    */
+   void setMaxSequenceDNABytes(size_t maxBytes);
+   size_t getSequenceDNABytes() const;
+
+   /**
+    * Keep the lookups (HAL to Side Graph maps) of added genomes to about
+    * maxBytes in total (0, the default, means no limit), counting 
+    * LookupIntervalBytes per interval.  Once no genome still to be added 
+    * (according to setGenomeOrder()) can map to a genome, its lookup is
+    * spilled to a temporary file as needed, biggest first.  Spilled 
+    * lookups are reloaded by computeJoins().  Must be called before 
+    * adding genomes.
+    */
+   void setMaxMemory(size_t maxBytes);
+   size_t getNumSpilledLookups() const;
+
+   /**
+    * Give the order genomes will be added in (by addGenome() or 
+    * addGenomesByClade()), so the last time each one is used as a 
+    * mapping target can be worked out for setMaxMemory().  Lookups
+    * are never spilled without it.
+    */
+   void setGenomeOrder(const std::vector<const hal::Genome*>& genomes);
+
    /**
     * Erase everything
     */
@@ -57,11 +203,47 @@ public:
                   hal_index_t start = 0,
                   hal_index_t length = 0);
 
+   /**
+    * Add a list of genomes, where the first is the reference and the rest
+    * are in the breadth first order that addGenome() would be called in.
+    * Each clade hanging off the reference is built into its own graph
+    * (in parallel when using more than one thread), and these graphs
+    * are merged on the reference afterwards.  Paths are the same as
+    * with addGenome(), but sequence IDs are assigned clade by clade and
+    * SNP bubbles are only shared across clades when all their bases 
+    * are already in the graph.  The clades split the DNA cache, preload,
+    * DNA store and setMaxMemory() budgets evenly, and follow the genome 
+    * order (if given) for their genomes.  If there is only one clade
+    * (eg the reference is a leaf) the genomes are just added in order.
+    */
+   void addGenomesByClade(const std::vector<const hal::Genome*>& genomes);
+
+   /**
+    * After each addGenome(), append everything it added to the builder
+    * (sequences and where they come from, SNPs, and the genome's lookup)
+    * to a new checkpoint file at path ("" to stop).  A run that dies 
+    * can then be continued with resumeCheckpoint().  Not supported with
+    * addGenomesByClade().
+    */
+   void setCheckpointPath(const std::string& path);
+
+   /**
+    * Restore the genomes added by a previous run from its checkpoint 
+    * file.  Must be called after init() (and the other settings) and
+    * before adding any genomes.  An incomplete last record is dropped,
+    * and checkpointing carries on in the same file.  Returns the genomes
+    * restored, in the order they were added.
+    */
+   std::vector<const hal::Genome*> resumeCheckpoint(const std::string& path);
+
    /**
     * Joins are computed in a second pass, after all genomes have been
     * added.  This pass will also performa a sanity check to make sure
-    * the graph contains a path for each input sequence */
-   void computeJoins(bool doAncestralJoins = true);
+    * the graph contains a path for each input sequence.  If pathSink
+    * is given, it gets every path as it is computed, and each genome's
+    * lookup is freed once all its paths are done (so getHalSequencePath()
+    * can't be used afterwards) */
+   void computeJoins(bool doAncestralJoins = true, PathSink* pathSink = NULL);
 
    /**
     * Get the Side Graph
@@ -69,13 +251,23 @@ public:
    const SideGraph* getSideGraph() const;
 
    /**
-    * Get DNA bases for a Side Graph sequence by querying the
-    * source sequence in the HAL file. 
+    * Get DNA bases for a Side Graph sequence.  They are read from the 
+    * DNA store (see setMaxSequenceDNABytes()) if the sequence is there,
+    * otherwise from HAL through the look back.
     */
    size_t getSequenceString(const SGSequence* sgSequence,
                             std::string& outString,
                             sg_int_t pos = 0,
                             sg_int_t length = -1) const;
+
+   /**
+    * Pack the DNA of short (<= PrefetchMaxLength) Side Graph sequences
+    * that aren't in memory yet into the DNA store, as many as fit, so 
+    * that exporting them doesn't cost one tiny HAL query each.  Their
+    * pieces are sorted by HAL sequence and offset, and nearby pieces 
+    * are read together.
+    */
+   void prefetchSequenceDNA();
    
 
    /** Returns true if sequence was created from the first genome added
@@ -118,12 +310,87 @@ protected:
       const hal::Sequence* _tgtSeq;
       bool _reversed;
    };
-   struct BlockPtrLess {
-      bool operator()(const Block* b1, const Block* b2) const;
+   /** Owns blocks in chunks so they don't need to be allocated and deleted
+    * one at a time.  Blocks stay valid until reset(), which frees them
+    * all at once (keeping the memory for reuse) */
+   class BlockArena {
+   public:
+      BlockArena();
+      ~BlockArena();
+      Block* allocate();
+      void reset();
+   protected:
+      BlockArena(const BlockArena&);
+      BlockArena& operator=(const BlockArena&);
+      static const size_t ChunkSize = 1024;
+      std::vector<Block*> _chunks;
+      size_t _chunk;
+      size_t _next;
+   };
+
+   /** sort key for a block (by src then tgt coordinates), with its index
+    * to break ties.  keeps sorting in contiguous memory */
+   struct BlockKey {
+      hal_index_t _srcStart;
+      hal_index_t _srcEnd;
+      hal_index_t _tgtStart;
+      hal_index_t _tgtEnd;
+      size_t _index;
+      bool operator<(const BlockKey& other) const;
    };
+
+   /** A sequence (range) to map, along with its alignment blocks and 
+    * their DNA when these are read ahead of time by a MapPipeline */
+   struct SequenceJob {
+      const hal::Sequence* _sequence;
+      hal_index_t _start;
+      hal_index_t _end;
+      bool _blocksReady;
+      BlockArena* _arena;
+      std::vector<Block*> _blocks;
+      // src and tgt DNA of each block, valid for [0, _dnaReady)
+      std::vector<std::string> _srcDNA;
+      std::vector<std::string> _tgtDNA;
+      size_t _dnaReady;
+   };
+
+   class MapPipeline;
+   class PathJoinsTask;
+   class BuildCladeTask;
    
 protected:
 
+   /** Merge a graph built by another builder (from the same first genome)
+    * into this one.  Sequences past those of the first genome are 
+    * renumbered, and the bases of SNP sequences that are already 
+    * present in our bubbles are dropped in favour of the existing ones
+    * (splitting the sequence if only some of them are).  other's 
+    * lookups are freed as they are merged.
+    */
+   void mergeBuilder(SGBuilder& other);
+
+   /** Copy length bases of one of other's sequences, starting at start,
+    * into a new sequence (along with its name, DNA, SNPs and lookback)
+    * and return the new sequence's ID */
+   sg_int_t mergeSequenceRun(const SGBuilder& other, sg_int_t otherSeqID,
+                             sg_int_t start, sg_int_t length,
+                             const std::vector<sg_int_t>& seqMap);
+
+   /** Smallest HAL position in a lookback path */
+   static hal_index_t getMinHalPos(const std::vector<SGSegment>& path);
+
+   /** Add a segment of one of other's paths (for HAL sequence halSeqID
+    * starting at halStart) to a lookup, translating its side graph 
+    * coordinates with the maps computed by mergeBuilder() */
+   void mergeLookupSegment(SGLookup* lookup, sg_int_t halSeqID,
+                           hal_index_t halStart, const SGSegment& seg,
+                           const std::vector<sg_int_t>& seqMap,
+                           const std::map<sg_int_t, std::vector<SGPosition> >&
+                           dupeMap);
+
+   /** Get our version of a sequence that may be from another handle */
+   const hal::Sequence* mergeSequence(const hal::Sequence* sequence);
+   
    /** Find the nearest genome in the Side Graph to align to */
    const hal::Genome* getTarget(const hal::Genome* genome);
 
@@ -132,15 +399,29 @@ protected:
    void mapSequence(const hal::Sequence* sequence,
                     hal_index_t globalStart,
                     hal_index_t globalEnd,
-                    const hal::Genome* target);
+                    const hal::Genome* target,
+                    SequenceJob* job = NULL,
+                    MapPipeline* pipeline = NULL);
 
    /** Compute the alignment blocks between a (sub)sequence and a 
-    * target genome */
+    * target genome using the given HAL reader.  Sequence, target and 
+    * the returned blocks are always in terms of reader 0 (_alignment). 
+    * Blocks are allocated from (and owned by) arena */
    void computeBlocks(const hal::Sequence* sequence,
                       hal_index_t globalStart,
                       hal_index_t globalEnd,
                       const hal::Genome* target,
-                      std::vector<Block*>& blocks);
+                      std::vector<Block*>& blocks,
+                      BlockArena& arena,
+                      size_t reader = 0);
+
+   /** Read the src and tgt DNA of a block using the given HAL reader 
+    * (virtual so the tests can make reads fail) */
+   virtual void getBlockDNA(const Block* block, std::string& outSrcDNA,
+                            std::string& outTgtDNA, size_t reader = 0) const;
+
+   /** Open the current mapping genomes in each HAL reader */
+   void prepareReaders(const hal::Genome* genome, const hal::Genome* target);
 
    /** Add a sequence (or part thereof to the sidegraph) and update
     * lookup structures (but not joins) */
@@ -162,19 +443,25 @@ protected:
                    const hal::Genome* srcGenome,
                    hal_index_t sequenceStart,
                    hal_index_t sequenceEnd,
-                   const hal::Genome* tgtGenome);
+                   const hal::Genome* tgtGenome,
+                   const std::string* srcDNA = NULL,
+                   const std::string* tgtDNA = NULL);
    
    /** Add interval (from blockmapper machinery) to the side graph.  
     * The interval maps from the new SOURCE genome to a TARGET genome
     * that is already in the side graph. 
     */
-   std::pair<SGSide, SGSide> mapBlockEnds(const Block* block);
+   std::pair<SGSide, SGSide> mapBlockEnds(const Block* block,
+                                          const std::string* srcDNA = NULL,
+                                          const std::string* tgtDNA = NULL);
 
    /** Add a block, breaking apart for SNPs. only add joins that are
     * contained in the block.  Update the endpoints if needed (as result of 
-    * snps) */
+    * snps).  The block's DNA is read from HAL unless given. */
    std::pair<SGSide, SGSide>
-   mapBlockBody(const Block*, const std::pair<SGSide, SGSide>& sgBlockEnds);
+   mapBlockBody(const Block*, const std::pair<SGSide, SGSide>& sgBlockEnds,
+                const std::string* srcDNA = NULL,
+                const std::string* tgtDNA = NULL);
 
    /** Add a slice of a block.  Either every base is a snp (snp==true) or
     * no bases are a snp.  hook on the previous hook. */
@@ -199,20 +486,128 @@ protected:
    bool isSelfBlock(const Block& block) const;
 
    /** cut sorted blocks list so blocks either dont overlap or completely
-    * overlap (all based on src coordinates) */
-   void cutBlocks(std::vector<Block*>&, bool leaveExactOverlaps = false);
+    * overlap (all based on src coordinates).  new blocks are allocated
+    * from arena */
+   void cutBlocks(std::vector<Block*>&, BlockArena& arena,
+                  bool leaveExactOverlaps = false);
 
    /** Add joins (and do sanity check) for one path corresponding to
     * one input hal sequence */
    void addPathJoins(const hal::Sequence* sequence,
-                     const std::vector<SGSegment>& path);
+                     const std::vector<SGSegment>& path,
+                     std::vector<std::pair<SGSide, SGSide> >* outJoins = NULL,
+                     size_t reader = 0);
+
+   /** Compute the joins of each sequence using the thread pool, then
+    * add them all to the graph at once */
+   void computeJoinsParallel(const std::vector<const hal::Sequence*>& 
+                             sequences, PathSink* pathSink);
+
+   /** Check the path of an input sequence according to _verifyLevel.  
+    * Throws hal_exception if it doesn't match */
+   void verifyPath(const hal::Sequence* sequence,
+                   const std::vector<SGSegment>& path,
+                   size_t reader) const;
+
+   /** Compare DNA of length bases of path segment seg, starting offset
+    * bases in (in path order), with sequence (where seg starts at halPos)
+    */
+   void verifySegmentDNA(const hal::Sequence* sequence, hal_index_t halPos,
+                         const SGSegment& seg, sg_int_t offset,
+                         sg_int_t length, size_t reader) const;
+
+   /** Check that each base of path segment seg (starting at halPos) is 
+    * covered by the look back, and compare DNA of any SNP sequences
+    */
+   void verifySegmentStructure(const hal::Sequence* sequence, 
+                               hal_index_t halPos,
+                               const SGSegment& seg, size_t reader) const;
+
+   /** Get DNA of a (reader 0) HAL sequence through the cache, using the
+    * reader's handle for anything not cached */
+   void readDNA(const hal::Sequence* sequence, hal_index_t pos,
+                hal_index_t length, std::string& outDNA, size_t reader) const;
+
+   /** Pack genome's DNA into _packedGenomes if it fits in the budget */
+   void preloadGenome(const hal::Genome* genome);
+
+   /** Get DNA from HAL sequence (inferring the CAMEL root if need be) */
+   void getHalDNA(const hal::Sequence* sequence, hal_index_t pos,
+                  hal_index_t length, std::string& outDNA,
+                  size_t reader) const;
+
+   bool isSNPSequence(sg_int_t sgSeqID) const;
+   
+   /** Delete the lookup of a genome whose paths are all done.  The 
+    * (NULL) entry is left in _luMap so it can be done while other 
+    * threads are searching it */
+   void freeLookup(const hal::Genome* genome);
+
+   /** Write the (finished) lookup of genome, made with seqNames, to a
+    * LookupSpill if it may need spilling.  Its paths are those of its
+    * sequences in _halSequences from firstHalSequence on */
+   void saveLookup(const hal::Genome* genome,
+                   const std::vector<std::string>& seqNames,
+                   size_t firstHalSequence);
+
+   /** Note that genome was added, so its target is needed one less time.
+    * Then spill finished lookups while over the memory limit */
+   void spillLookups(const std::string& genomeName);
+
+   /** Reload the lookup of genome if it was spilled */
+   void loadLookup(const hal::Genome* genome);
+
+   /** Write the checkpoint record for genome, whose addGenome() made
+    * the sequences from firstSGSequence on and the HAL paths from 
+    * firstHalSequence on */
+   void writeCheckpoint(const hal::Genome* genome,
+                        const std::vector<std::string>& seqNames,
+                        sg_int_t firstSGSequence, size_t firstHalSequence);
+
+   /** Redo the addGenome() that wrote record, returning its genome */
+   const hal::Genome* restoreCheckpoint(const std::string& record);
+
+   /** Read a genome and sequence name from a checkpoint record */
+   const hal::Sequence* readCheckpointSequence(
+     SGCheckpoint::Reader& reader) const;
+
+   /** getSequenceString() rebuilding the DNA from HAL through the 
+    * look back */
+   size_t getLookBackSequenceString(const SGSequence* sgSequence,
+                                    std::string& outString,
+                                    sg_int_t pos,
+                                    sg_int_t length,
+                                    size_t reader) const;
+
+   /** For prefetchSequenceDNA(): interval of a Side Graph sequence, 
+    * along with where it comes from in HAL */
+   struct DNAPiece
+   {
+      const hal::Sequence* _halSequence;
+      hal_index_t _halStart;
+      hal_index_t _length;
+      bool _forward;
+      sg_int_t _sgSeqID;
+      sg_int_t _offset;
+      bool operator<(const DNAPiece& other) const;
+   };
+
+   /** getSequenceString() reading DNA from the given HAL reader */
+   size_t getSequenceString(const SGSequence* sgSequence,
+                            std::string& outString,
+                            sg_int_t pos,
+                            sg_int_t length,
+                            size_t reader) const;
 
    /** We are anchoring on the root genome (at least for now).  But in
     * Adams output, the root sequence is Ns which is a problem.  We 
     * use the function as an override to map a root sequence from its 
-    * children using the knowledge that there are no substitutions */
+    * children using the knowledge that there are no substitutions.
+    * Only the part needed is inferred (through _rootDNACache), using 
+    * the reader's handle for the reader 0 sequence */
    void getRootSubString(std::string& outDNA, const hal::Sequence* sequence,
-                         hal_index_t pos, hal_index_t length) const;
+                         hal_index_t pos, hal_index_t length,
+                         size_t reader) const;
 
    
    // Logic added only for collapsing new sequences (ie handling dupes
@@ -258,16 +653,55 @@ protected:
    const hal::Genome* _mapMrca;
    bool _referenceDupes;
    bool _inferRootSeq;
-   mutable std::string _rootString;
+   mutable RootDNACache _rootDNACache;
    bool _camelMode;
+   bool _camelChecked;
+   double _camelCheckSeconds;
    size_t _pathLength;
    std::string _firstGenomeName;
+   sg_int_t _numFirstGenomeSequences;
    std::vector<const hal::Sequence*> _halSequences;
    SNPHandler* _snpHandler;
    bool _onlySequenceNames; // dont add genome to path names
    bool _stripSequenceNames; // dont write name field of sgsequences
+   bool _lazySequenceNames;
+   SGSeqNames _seqNames;
    // list of sequences to not self-align
    std::set<const hal::Sequence*> _refPathSequences;
+   SGThreadPool _threadPool;
+   // one HAL handle per thread, with reader 0 being _alignment
+   HALReaderPool _readerPool;
+   // _mapPath opened in each reader
+   std::vector<std::set<const hal::Genome*> > _readerMapPaths;
+   // for getTarget(): genomes in _luMap are marked
+   GenomeTreeIndex _treeIndex;
+   VerifyLevel _verifyLevel;
+   // by SG sequence id: was it made by the SNP handler?
+   std::vector<bool> _snpSequences;
+   mutable DNACache _dnaCache;
+   // preloaded DNA of target genomes, by sequence array index
+   typedef std::map<const hal::Genome*, std::vector<PackedDNA> > 
+   PackedGenomeMap;
+   PackedGenomeMap _packedGenomes;
+   size_t _maxPreloadBytes;
+   size_t _preloadBytes;
+   // copies of the lookups that can be spilled, by genome name
+   typedef std::map<std::string, LookupSpill*> LookupSpillMap;
+   LookupSpillMap _lookupSpills;
+   size_t _maxMemory;
+   size_t _numSpilledLookups;
+   // from setGenomeOrder(): target of each genome, and how many genomes
+   // still to be added will use each genome as target 
+   std::map<std::string, std::string> _plannedTargets;
+   std::map<std::string, size_t> _pendingTargetUses;
+   SGCheckpoint _checkpoint;
+   // DNA of Side Graph sequences, while it fits
+   PackedDNAStore _sgDNA;
+   std::map<const hal::Sequence*, const hal::Sequence*> _mergeSeqMap;
+   // blocks for mapSequence() and (separately since it's called from
+   // there) createSGSequence()
+   BlockArena _blockArena;
+   BlockArena _dupeBlockArena;
 
    friend std::ostream& operator<<(std::ostream& os, const Block* block);
 
@@ -275,37 +709,60 @@ protected:
 
 std::ostream& operator<<(std::ostream& os, const SGBuilder::Block* block);
 
-inline bool SGBuilder::BlockPtrLess::operator()(const SGBuilder::Block* b1,
-                                                const SGBuilder::Block* b2)
+inline SGBuilder::BlockArena::BlockArena() : _chunk(0), _next(0)
+{
+}
+
+inline SGBuilder::BlockArena::~BlockArena()
+{
+  for (size_t i = 0; i < _chunks.size(); ++i)
+  {
+    delete [] _chunks[i];
+  }
+}
+
+inline SGBuilder::Block* SGBuilder::BlockArena::allocate()
+{
+  if (_next == ChunkSize)
+  {
+    ++_chunk;
+    _next = 0;
+  }
+  if (_chunk == _chunks.size())
+  {
+    _chunks.push_back(new Block[ChunkSize]);
+  }
+  Block* block = _chunks[_chunk] + _next++;
+  *block = Block();
+  return block;
+}
+
+inline void SGBuilder::BlockArena::reset()
+{
+  _chunk = 0;
+  _next = 0;
+}
+
+inline bool SGBuilder::BlockKey::operator<(const SGBuilder::BlockKey& other)
   const
 {
-  assert(b1->_srcSeq == b2->_srcSeq);
-  if (b1->_srcStart < b2->_srcStart)
+  if (_srcStart != other._srcStart)
   {
-    return true;
+    return _srcStart < other._srcStart;
   }
-  else if (b1->_srcStart == b2->_srcStart)
+  if (_srcEnd != other._srcEnd)
   {
-    if (b1->_srcEnd < b2->_srcEnd)
-    {
-      return true;
-    }
-    else if (b1->_srcEnd == b2->_srcEnd)
-    {
-      if (b1->_tgtStart < b2->_tgtStart)
-      {
-        return true;
-      }
-      else if (b1->_tgtStart == b2->_tgtStart)
-      {
-        if (b1->_tgtEnd < b2->_tgtEnd)
-        {
-          return true;
-        }
-      }
-    }
+    return _srcEnd < other._srcEnd;
   }
-  return false;
+  if (_tgtStart != other._tgtStart)
+  {
+    return _tgtStart < other._tgtStart;
+  }
+  if (_tgtEnd != other._tgtEnd)
+  {
+    return _tgtEnd < other._tgtEnd;
+  }
+  return _index < other._index;
 }
 
 inline std::ostream& operator<<(std::ostream& os,
@@ -340,6 +797,51 @@ inline bool SGBuilder::SeqLess::operator()(const hal::Sequence* s1,
   return s1->getFullName() < s2->getFullName();
 }
 
+inline size_t SGBuilder::getNumThreads() const
+{
+  return _threadPool.getNumThreads();
+}
+
+inline SGBuilder::VerifyLevel SGBuilder::getVerifyLevel() const
+{
+  return _verifyLevel;
+}
+
+inline const DNACache& SGBuilder::getDNACache() const
+{
+  return _dnaCache;
+}
+
+inline double SGBuilder::getCamelCheckSeconds() const
+{
+  return _camelCheckSeconds;
+}
+
+inline size_t SGBuilder::getSequenceDNABytes() const
+{
+  return _sgDNA.getNumBytes();
+}
+
+inline size_t SGBuilder::getPreloadBytes() const
+{
+  return _preloadBytes;
+}
+
+inline size_t SGBuilder::getNumPreloadedGenomes() const
+{
+  return _packedGenomes.size();
+}
+
+inline size_t SGBuilder::getNumSpilledLookups() const
+{
+  return _numSpilledLookups;
+}
+
+inline bool SGBuilder::isSNPSequence(sg_int_t sgSeqID) const
+{
+  return sgSeqID < (sg_int_t)_snpSequences.size() && _snpSequences[sgSeqID];
+}
+
 inline const std::string SGBuilder::getHalSeqName(const hal::Sequence*
                                                   halSeq) const
 {
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+
+#include "hal.h"
+#include "sgcheckpoint.h"
+
+using namespace std;
+using namespace hal;
+
+const char* SGCheckpoint::Header = "HAL2SGCK";
+const char* SGCheckpoint::Trailer = "SGCKEND\n";
+
+// both 8 bytes
+static const size_t TagLength = 8;
+
+SGCheckpoint::SGCheckpoint() : _file(NULL), _goodLength(0), _reading(false)
+{
+}
+
+SGCheckpoint::~SGCheckpoint()
+{
+  close();
+}
+
+void SGCheckpoint::create(const string& path)
+{
+  close();
+  _path = path;
+  _file = fopen(path.c_str(), "wb");
+  if (_file == NULL)
+  {
+    throw hal_exception("error creating checkpoint file " + path);
+  }
+  if (fwrite(Header, 1, TagLength, _file) != TagLength || fflush(_file) != 0)
+  {
+    throw hal_exception("error writing checkpoint file " + path);
+  }
+}
+
+void SGCheckpoint::resume(const string& path)
+{
+  close();
+  _path = path;
+  _file = fopen(path.c_str(), "rb");
+  if (_file == NULL)
+  {
+    throw hal_exception("error opening checkpoint file " + path);
+  }
+  char header[TagLength];
+  if (fread(header, 1, TagLength, _file) != TagLength ||
+      memcmp(header, Header, TagLength) != 0)
+  {
+    throw hal_exception(path + " is not a hal2sg checkpoint file");
+  }
+  _goodLength = TagLength;
+  _reading = true;
+}
+
+bool SGCheckpoint::readRecord(string& outRecord)
+{
+  assert(_reading == true);
+  sg_int_t length = -1;
+  sg_int_t trailerLength = -1;
+  char trailer[TagLength];
+  if (fread(&length, sizeof(length), 1, _file) == 1 && length >= 0)
+  {
+    outRecord.resize(length);
+    if ((length == 0 || 
+         fread(&outRecord[0], 1, length, _file) == (size_t)length) &&
+        fread(&trailerLength, sizeof(trailerLength), 1, _file) == 1 &&
+        trailerLength == length &&
+        fread(trailer, 1, TagLength, _file) == TagLength &&
+        memcmp(trailer, Trailer, TagLength) == 0)
+    {
+      _goodLength += 2 * sizeof(length) + length + TagLength;
+      return true;
+    }
+  }
+
+  // end of the good records: drop the rest and switch to appending
+  fclose(_file);
+  _file = NULL;
+  _reading = false;
+  if (truncate(_path.c_str(), _goodLength) != 0)
+  {
+    throw hal_exception("error truncating checkpoint file " + _path);
+  }
+  _file = fopen(_path.c_str(), "ab");
+  if (_file == NULL)
+  {
+    throw hal_exception("error opening checkpoint file " + _path);
+  }
+  return false;
+}
+
+void SGCheckpoint::writeRecord(const string& record)
+{
+  assert(_file != NULL && _reading == false);
+  sg_int_t length = record.length();
+  if (fwrite(&length, sizeof(length), 1, _file) != 1 ||
+      fwrite(record.data(), 1, record.length(), _file) != record.length() ||
+      fwrite(&length, sizeof(length), 1, _file) != 1 ||
+      fwrite(Trailer, 1, TagLength, _file) != TagLength ||
+      fflush(_file) != 0 ||
+      // to the disk, not just the OS, so it survives a machine crash
+      fsync(fileno(_file)) != 0)
+  {
+    throw hal_exception("error writing checkpoint file " + _path);
+  }
+}
+
+void SGCheckpoint::close()
+{
+  if (_file != NULL)
+  {
+    fclose(_file);
+    _file = NULL;
+  }
+  _reading = false;
+}
+
+void SGCheckpoint::putInt(string& record, sg_int_t value)
+{
+  record.append((const char*)&value, sizeof(value));
+}
+
+void SGCheckpoint::putString(string& record, const string& value)
+{
+  putInt(record, value.length());
+  record.append(value);
+}
+
+SGCheckpoint::Reader::Reader(const string& record) : _record(record), _pos(0)
+{
+}
+
+sg_int_t SGCheckpoint::Reader::getInt()
+{
+  sg_int_t value;
+  get((char*)&value, sizeof(value));
+  return value;
+}
+
+string SGCheckpoint::Reader::getString()
+{
+  sg_int_t length = getInt();
+  if (length < 0 || _pos + length > _record.length())
+  {
+    throw hal_exception("corrupt checkpoint record");
+  }
+  string value = _record.substr(_pos, length);
+  _pos += length;
+  return value;
+}
+
+void SGCheckpoint::Reader::get(char* buffer, size_t length)
+{
+  if (_pos + length > _record.length())
+  {
+    throw hal_exception("corrupt checkpoint record");
+  }
+  memcpy(buffer, _record.data() + _pos, length);
+  _pos += length;
+}
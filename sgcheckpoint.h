@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _SGCHECKPOINT_H
+#define _SGCHECKPOINT_H
+
+#include <cstdio>
+#include <string>
+
+#include "sgcommon.h"
+
+/*
+ * Append-only file of records (opaque byte strings), written as a 
+ * stream so that the cost of each record is only its own size.  Each 
+ * record is framed by its length and followed by a trailer, and flushed
+ * once written.  A record that didn't get all the way to disk (ie the
+ * process was killed while writing it) is detected when resuming, and 
+ * cut off so that writing can continue after the last complete one.
+ *
+ * Records are built and parsed with the put*() and Reader helpers.
+ * Integers are written in native byte order.
+ */
+class SGCheckpoint
+{
+public:
+
+   SGCheckpoint();
+   ~SGCheckpoint();
+
+   /** Start a new (empty) checkpoint file at path */
+   void create(const std::string& path);
+   
+   /** Open an existing checkpoint at path to read its records with 
+    * readRecord(), then to append more */
+   void resume(const std::string& path);
+
+   /** Get the next complete record from a resumed file.  Returns false
+    * once there are none left, at which point anything after the last
+    * complete record is removed. */
+   bool readRecord(std::string& outRecord);
+
+   /** Append a record, which is synced to disk (fsync) once this
+    * returns */
+   void writeRecord(const std::string& record);
+
+   void close();
+   const std::string& getPath() const;
+   bool isOpen() const;
+   
+   static void putInt(std::string& record, sg_int_t value);
+   static void putString(std::string& record, const std::string& value);
+   
+   /** Parse a record made with putInt() and putString() */
+   class Reader
+   {
+   public:
+      Reader(const std::string& record);
+      sg_int_t getInt();
+      std::string getString();
+   protected:
+      void get(char* buffer, size_t length);
+      const std::string& _record;
+      size_t _pos;
+   };
+
+   static const char* Header;
+   static const char* Trailer;
+   
+protected:
+
+   std::string _path;
+   FILE* _file;
+   // (resume) bytes of the file known to be good 
+   long _goodLength;
+   bool _reading;
+};
+
+inline const std::string& SGCheckpoint::getPath() const
+{
+  return _path;
+}
+
+inline bool SGCheckpoint::isOpen() const
+{
+  return _file != NULL;
+}
+
+#endif
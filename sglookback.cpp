@@ -5,7 +5,7 @@
  */
 
 #include <limits>
-#include <sstream>
+#include <algorithm>
 
 #include "hal.h"
 #include "sglookback.h"
@@ -25,43 +25,135 @@ SGLookBack::~SGLookBack()
 
 void SGLookBack::clear()
 {
-  _lookup = SGLookup();
-  _halSeqMap.clear();
+  _entries.clear();
 }
 
 void SGLookBack::addInterval(const SGPosition& inPos, const Sequence* outSeq,
                              hal_index_t outOffset, 
                              sg_int_t length, bool reversed)
 {
-  if (_halSeqMap.size() <= inPos.getSeqID())
+  assert(inPos.getSeqID() >= 0 && inPos.getPos() >= 0);
+  assert(length > 0);
+  if (_entries.size() <= inPos.getSeqID())
   {
-    size_t oldSize = _halSeqMap.size();
-    _halSeqMap.resize(inPos.getSeqID() + 1, NULL);
-    size_t newSize = _halSeqMap.size();
-    // little hack to resize lookup with fake names
-    for (size_t i = oldSize; i < newSize; ++i)
+    _entries.resize(inPos.getSeqID() + 1);
+  }
+  Entry& entry = _entries[inPos.getSeqID()];
+  assert(entry._halSequence == outSeq || entry._halSequence == NULL);
+  entry._halSequence = outSeq;
+
+  Interval interval;
+  interval._start = inPos.getPos();
+  interval._halStart = outOffset;
+  interval._length = length;
+  interval._reversed = reversed;
+
+  if (entry._numIntervals == 0)
+  {
+    entry._first = interval;
+    entry._numIntervals = 1;
+    return;
+  }
+
+  // intervals are almost always added in order, and usually continue
+  // the previous one, in which case we just extend it
+  Interval& last = entry.getInterval(entry._numIntervals - 1);
+  if (interval._start >= last._start + last._length)
+  {
+    if (interval._start == last._start + last._length &&
+        interval._reversed == last._reversed &&
+        (reversed == false ? 
+         interval._halStart == last._halStart + last._length :
+         interval._halStart + interval._length == last._halStart))
+    {
+      if (reversed == true)
+      {
+        last._halStart = interval._halStart;
+      }
+      last._length += interval._length;
+    }
+    else
+    {
+      entry._more.push_back(interval);
+      ++entry._numIntervals;
+    }
+    return;
+  }
+
+  // out of order: insert to keep everything sorted by start
+  sg_int_t prev = findInterval(entry, interval._start);
+  assert(prev < 0 || 
+         entry.getInterval(prev)._start + entry.getInterval(prev)._length <=
+         interval._start);
+  if (prev < 0)
+  {
+    entry._more.insert(entry._more.begin(), entry._first);
+    entry._first = interval;
+  }
+  else
+  {
+    entry._more.insert(entry._more.begin() + prev, interval);
+  }
+  ++entry._numIntervals;
+}
+
+sg_int_t SGLookBack::findInterval(const Entry& entry, sg_int_t pos)
+{
+  if (entry._numIntervals == 0 || pos < entry._first._start)
+  {
+    return -1;
+  }
+  // binary search on _more for last interval with start <= pos 
+  size_t lo = 0;
+  size_t hi = entry._more.size();
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entry._more[mid]._start <= pos)
+    {
+      lo = mid + 1;
+    }
+    else
     {
-      stringstream ss;
-      ss << i;
-      _lookup.addSequence(ss.str());
+      hi = mid;
     }
   }
-  assert(_halSeqMap[inPos.getSeqID()] == outSeq ||
-         _halSeqMap[inPos.getSeqID()] == NULL);
-  if (_halSeqMap[inPos.getSeqID()] == NULL)
+  // lo intervals in _more start at or before pos, plus _first
+  return (sg_int_t)lo;
+}
+
+SGSide SGLookBack::getHalSide(const Interval& interval, sg_int_t pos)
+{
+  assert(pos >= interval._start && pos < interval._start + interval._length);
+  sg_int_t offset = pos - interval._start;
+  if (interval._reversed == false)
   {
-    _halSeqMap[inPos.getSeqID()] = outSeq;
+    return SGSide(SGPosition(0, interval._halStart + offset), true);
   }
-  _lookup.addInterval(inPos, SGPosition(inPos.getSeqID(), outOffset),
-                      length, reversed);
+  return SGSide(SGPosition(0, interval._halStart + interval._length - 1 - 
+                           offset), false);
 }
 
 pair<const Sequence*, SGSide>
 SGLookBack::mapPosition(const SGPosition& inPos) const
 {
-  assert(_halSeqMap.size() > inPos.getSeqID());
-  SGSide mapSide = _lookup.mapPosition(inPos);
-  return pair<const Sequence*, SGSide>(_halSeqMap[inPos.getSeqID()], mapSide);
+  assert(_entries.size() > inPos.getSeqID());
+  const Entry& entry = _entries[inPos.getSeqID()];
+  sg_int_t idx = findInterval(entry, inPos.getPos());
+  if (idx >= 0)
+  {
+    const Interval& interval = entry.getInterval(idx);
+    if (inPos.getPos() < interval._start + interval._length)
+    {
+      SGSide mapSide = getHalSide(interval, inPos.getPos());
+      SGPosition base = mapSide.getBase();
+      base.setSeqID(inPos.getSeqID());
+      mapSide.setBase(base);
+      return pair<const Sequence*, SGSide>(entry._halSequence, mapSide);
+    }
+  }
+  return pair<const Sequence*, SGSide>(NULL, SGSide(SGPosition(-1, -1),
+                                                    true));
 }
 
 void SGLookBack::getPath(const SGPosition& startPos,
@@ -70,10 +162,63 @@ void SGLookBack::getPath(const SGPosition& startPos,
                          vector<SGSegment>& outPath,
                          vector<const Sequence*>& outHalSeqs) const
 {
-  _lookup.getPath(startPos, length, forward, outPath);
-  outHalSeqs.resize(outPath.size(), NULL);
-  for (size_t i = 0; i < outPath.size(); ++i)
+  outPath.clear();
+  outHalSeqs.clear();
+  assert(_entries.size() > startPos.getSeqID());
+  const Entry& entry = _entries[startPos.getSeqID()];
+  sg_int_t seqID = startPos.getSeqID();
+  sg_int_t pos = startPos.getPos();
+  sg_int_t end = pos + length;
+  sg_int_t idx = findInterval(entry, pos);
+  
+  while (pos < end)
+  {
+    const Interval* interval = idx >= 0 && idx < (sg_int_t)entry._numIntervals ?
+       &entry.getInterval(idx) : NULL;
+    if (interval != NULL && pos >= interval->_start &&
+        pos < interval->_start + interval->_length)
+    {
+      sg_int_t segLength = min(end, interval->_start + interval->_length) -
+         pos;
+      SGSide side = getHalSide(*interval, pos);
+      side.setBase(SGPosition(seqID, side.getBase().getPos()));
+      outPath.push_back(SGSegment(side, segLength));
+      outHalSeqs.push_back(entry._halSequence);
+      pos += segLength;
+      ++idx;
+    }
+    else
+    {
+      // hole up to the next interval (or end of range)
+      if (interval == NULL || pos >= interval->_start)
+      {
+        ++idx;
+      }
+      sg_int_t next = idx < (sg_int_t)entry._numIntervals ?
+         entry.getInterval(idx)._start : end;
+      sg_int_t segLength = min(end, next) - pos;
+      outPath.push_back(SGSegment(SGSide(SGPosition(seqID, -1), true),
+                                  segLength));
+      outHalSeqs.push_back(NULL);
+      pos += segLength;
+    }
+  }
+
+  if (forward == false)
   {
-    outHalSeqs[i] = _halSeqMap[outPath[i].getSide().getBase().getSeqID()];
+    reverse(outPath.begin(), outPath.end());
+    reverse(outHalSeqs.begin(), outHalSeqs.end());
+    for (size_t i = 0; i < outPath.size(); ++i)
+    {
+      const SGSegment& seg = outPath[i];
+      if (seg.getSide().getBase().getPos() >= 0)
+      {
+        SGPosition flipPos = seg.getSide().getForward() ? seg.getMaxPos() :
+           seg.getMinPos();
+        outPath[i] = SGSegment(SGSide(flipPos, 
+                                      !seg.getSide().getForward()),
+                               seg.getLength());
+      }
+    }
   }
 }
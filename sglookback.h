@@ -11,11 +11,12 @@
 #include "sglookup.h"
 
 /*
- * Wrap SGLookup structure to make something that could map in other
- * direction.  Issue is that hal sequence ids are not globally unique 
- * (rather only unique per genome).  So we add a little table to keep track
- * of this rather than changing SGLookup itself.. The other change is not
- * being able to specify number of sequences in init. 
+ * Map Side Graph sequences back to the HAL intervals they come from.
+ * Every Side Graph sequence comes from a single HAL sequence, so we keep
+ * a table indexed by Side Graph sequence id, each entry holding its HAL
+ * sequence and a sorted run of intervals.  The first interval is stored
+ * in the entry itself, as most (ie SNP) sequences only ever have one.  
+ * Intervals that continue the last one are merged into it.
  */
 class SGLookBack
 {
@@ -37,7 +38,8 @@ public:
      const SGPosition& inPos) const;
 
    /** Get a path of an inclusive range in a single SG sequence
-    * through the HAL graph.   
+    * through the HAL graph.  Any part of the range that wasn't added
+    * gets a segment with a negative position and a NULL HAL sequence.
     */
    void getPath(const SGPosition& startPos,
                 int length,
@@ -49,14 +51,56 @@ public:
    
 protected:
 
-   std::vector<const hal::Sequence*> _halSeqMap;
-   SGLookup _lookup;
+   struct Interval
+   {
+      sg_int_t _start;
+      hal_index_t _halStart;
+      sg_int_t _length;
+      bool _reversed;
+   };
+
+   struct Entry
+   {
+      Entry();
+      const hal::Sequence* _halSequence;
+      size_t _numIntervals;
+      Interval _first;
+      std::vector<Interval> _more;
+      const Interval& getInterval(size_t i) const;
+      Interval& getInterval(size_t i);
+   };
+
+   /** Index of the last interval in entry starting at or before pos
+    * (-1 if none) */
+   static sg_int_t findInterval(const Entry& entry, sg_int_t pos);
+   /** Side of HAL position corresponding to pos (which must be in 
+    * interval) */
+   static SGSide getHalSide(const Interval& interval, sg_int_t pos);
+
+   std::vector<Entry> _entries;
 };
 
+inline SGLookBack::Entry::Entry() : _halSequence(NULL), _numIntervals(0)
+{
+}
+
+inline const SGLookBack::Interval& SGLookBack::Entry::getInterval(size_t i)
+  const
+{
+  assert(i < _numIntervals);
+  return i == 0 ? _first : _more[i - 1];
+}
+
+inline SGLookBack::Interval& SGLookBack::Entry::getInterval(size_t i)
+{
+  assert(i < _numIntervals);
+  return i == 0 ? _first : _more[i - 1];
+}
+
 inline std::string SGLookBack::getHalGenomeName(const SGSequence* sgSeq) const
 {
-  assert(sgSeq->getID() < _halSeqMap.size());
-  return _halSeqMap[sgSeq->getID()]->getGenome()->getName();
+  assert(sgSeq->getID() < _entries.size());
+  return _entries[sgSeq->getID()]._halSequence->getGenome()->getName();
 }
 
 #endif
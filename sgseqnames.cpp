@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <cassert>
+#include <stdint.h>
+
+#include "sgseqnames.h"
+
+using namespace std;
+using namespace hal;
+
+SGSeqNames::SGSeqNames(bool onlySequenceNames) : 
+  _onlySequenceNames(onlySequenceNames)
+{
+}
+
+SGSeqNames::~SGSeqNames()
+{
+}
+
+void SGSeqNames::clear()
+{
+  // actually free the memory
+  vector<Origin>().swap(_origins);
+}
+
+void SGSeqNames::setOnlySequenceNames(bool onlySequenceNames)
+{
+  _onlySequenceNames = onlySequenceNames;
+}
+
+void SGSeqNames::setOrigin(sg_int_t sgSeqID, const Sequence* halSequence,
+                           hal_index_t offset, hal_index_t length)
+{
+  assert(sgSeqID >= 0 && length >= 0);
+  if (sgSeqID >= (sg_int_t)_origins.size())
+  {
+    _origins.resize(sgSeqID + 1);
+  }
+  Origin& origin = _origins[sgSeqID];
+  origin._halSequence = halSequence;
+  origin._offset = offset;
+  origin._length = length;
+}
+
+void SGSeqNames::getName(sg_int_t sgSeqID, string& outName) const
+{
+  assert(hasOrigin(sgSeqID));
+  const Origin& origin = _origins[sgSeqID];
+  outName.clear();
+  if (origin._halSequence != NULL)
+  {
+    outName = _onlySequenceNames ? origin._halSequence->getName() :
+       origin._halSequence->getFullName();
+  }
+  if (origin._offset >= 0)
+  {
+    appendRange(outName, origin._offset, origin._length);
+  }
+}
+
+void SGSeqNames::appendRange(string& outName, hal_index_t offset,
+                             hal_index_t length)
+{
+  outName.push_back('_');
+  appendInt(outName, offset);
+  outName.push_back('_');
+  appendInt(outName, length);
+}
+
+void SGSeqNames::appendInt(string& outString, hal_index_t value)
+{
+  char digits[20];
+  size_t numDigits = 0;
+  if (value < 0)
+  {
+    outString.push_back('-');
+  }
+  uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+  do
+  {
+    digits[numDigits++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+  while (numDigits > 0)
+  {
+    outString.push_back(digits[--numDigits]);
+  }
+}
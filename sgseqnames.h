@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _SGSEQNAMES_H
+#define _SGSEQNAMES_H
+
+#include <string>
+#include <vector>
+
+#include "hal.h"
+#include "sgcommon.h"
+
+/*
+ * Names of Side Graph sequences, kept as where they come from (a range
+ * of a HAL sequence) instead of as strings.  The name is only made 
+ * when asked for (ie by SGBuilder::nameSequences() before export), as
+ *   <HAL sequence name>[_<offset>_<length>]
+ * where the range is left off for sequences that cover all of the 
+ * HAL sequence.  A NULL HAL sequence gives an empty prefix. 
+ */
+class SGSeqNames
+{
+public:
+
+   SGSeqNames(bool onlySequenceNames = false);
+   ~SGSeqNames();
+
+   void clear();
+
+   /** Use HAL sequence names instead of Genome.Sequence */
+   void setOnlySequenceNames(bool onlySequenceNames);
+
+   /** Remember where Side Graph sequence sgSeqID comes from (offset < 0
+    * for all of halSequence) */
+   void setOrigin(sg_int_t sgSeqID, const hal::Sequence* halSequence,
+                  hal_index_t offset, hal_index_t length);
+
+   /** Was setOrigin() called for sgSeqID */
+   bool hasOrigin(sg_int_t sgSeqID) const;
+   
+   const hal::Sequence* getHalSequence(sg_int_t sgSeqID) const;
+   hal_index_t getOffset(sg_int_t sgSeqID) const;
+   hal_index_t getLength(sg_int_t sgSeqID) const;
+   
+   /** Make the name of sgSeqID (which must have an origin) */
+   void getName(sg_int_t sgSeqID, std::string& outName) const;
+
+   /** Append "_<offset>_<length>" to name */
+   static void appendRange(std::string& outName, hal_index_t offset,
+                           hal_index_t length);
+
+   static const size_t MaxRangeLength = 42;
+
+protected:
+
+   static void appendInt(std::string& outString, hal_index_t value);
+
+   struct Origin
+   {
+      Origin();
+      const hal::Sequence* _halSequence;
+      hal_index_t _offset;
+      // -1 if no origin
+      hal_index_t _length;
+   };
+
+   std::vector<Origin> _origins;
+   bool _onlySequenceNames;
+};
+
+inline SGSeqNames::Origin::Origin() : _halSequence(NULL), _offset(-1),
+                                      _length(-1)
+{
+}
+
+inline bool SGSeqNames::hasOrigin(sg_int_t sgSeqID) const
+{
+  return sgSeqID < (sg_int_t)_origins.size() && 
+     _origins[sgSeqID]._length >= 0;
+}
+
+inline const hal::Sequence* SGSeqNames::getHalSequence(sg_int_t sgSeqID) 
+  const
+{
+  assert(hasOrigin(sgSeqID));
+  return _origins[sgSeqID]._halSequence;
+}
+
+inline hal_index_t SGSeqNames::getOffset(sg_int_t sgSeqID) const
+{
+  assert(hasOrigin(sgSeqID));
+  return _origins[sgSeqID]._offset;
+}
+
+inline hal_index_t SGSeqNames::getLength(sg_int_t sgSeqID) const
+{
+  assert(hasOrigin(sgSeqID));
+  return _origins[sgSeqID]._length;
+}
+
+#endif
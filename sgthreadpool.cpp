@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <vector>
+#include <exception>
+#include <cassert>
+
+#include "hal.h"
+#include "sgthreadpool.h"
+
+using namespace std;
+using namespace hal;
+
+SGThreadPool::SGThreadPool(size_t numThreads) : _numThreads(1), _task(0),
+                                                _numItems(0), _next(0),
+                                                _failed(false)
+{
+  pthread_mutex_init(&_mutex, NULL);
+  setNumThreads(numThreads);
+}
+
+SGThreadPool::~SGThreadPool()
+{
+  pthread_mutex_destroy(&_mutex);
+}
+
+void SGThreadPool::setNumThreads(size_t numThreads)
+{
+  _numThreads = numThreads > 0 ? numThreads : 1;
+}
+
+void SGThreadPool::parallelFor(size_t numItems, Task* task)
+{
+  // no point in starting more threads than there is work
+  size_t numThreads = min(_numThreads, max(numItems, (size_t)1));
+  startThreads(numItems, task, numThreads);
+  // work() checks for failure (ie in startThreads()) itself
+  work(0);
+  wait();
+}
+
+void SGThreadPool::start(size_t numItems, Task* task)
+{
+  assert(_numThreads > 1);
+  startThreads(numItems, task, _numThreads);
+  pthread_mutex_lock(&_mutex);
+  bool failed = _failed;
+  pthread_mutex_unlock(&_mutex);
+  if (failed == true)
+  {
+    // nobody would be left to do the work
+    wait();
+  }
+}
+
+void SGThreadPool::startThreads(size_t numItems, Task* task,
+                                size_t numThreads)
+{
+  assert(_task == NULL);
+  _task = task;
+  _numItems = numItems;
+  _next = 0;
+  _failed = false;
+  _error.erase();
+
+  _threads.resize(numThreads);
+  _args.resize(numThreads);
+  for (size_t i = 1; i < numThreads; ++i)
+  {
+    _args[i]._pool = this;
+    _args[i]._threadIdx = i;
+    if (pthread_create(&_threads[i], NULL, threadMain, &_args[i]) != 0)
+    {
+      // stop the threads we've got
+      setFailed("pthread_create failed");
+      _threads.resize(i);
+      break;
+    }
+  }
+}
+
+void SGThreadPool::wait()
+{
+  for (size_t i = 1; i < _threads.size(); ++i)
+  {
+    pthread_join(_threads[i], NULL);
+  }
+  _threads.clear();
+  _task = NULL;
+
+  if (_failed == true)
+  {
+    throw hal_exception(_error);
+  }
+}
+
+void* SGThreadPool::threadMain(void* arg)
+{
+  ThreadArg* threadArg = static_cast<ThreadArg*>(arg);
+  threadArg->_pool->work(threadArg->_threadIdx);
+  return NULL;
+}
+
+void SGThreadPool::work(size_t threadIdx)
+{
+  while (true)
+  {
+    size_t index;
+    pthread_mutex_lock(&_mutex);
+    index = _next++;
+    bool done = _failed || index >= _numItems;
+    pthread_mutex_unlock(&_mutex);
+    if (done)
+    {
+      break;
+    }
+    try
+    {
+      _task->run(index, threadIdx);
+    }
+    catch (exception& e)
+    {
+      setFailed(e.what());
+    }
+    catch (...)
+    {
+      setFailed("unknown exception in worker thread");
+    }
+  }
+}
+
+void SGThreadPool::setFailed(const string& error)
+{
+  pthread_mutex_lock(&_mutex);
+  if (_failed == false)
+  {
+    _failed = true;
+    _error = error;
+  }
+  pthread_mutex_unlock(&_mutex);
+}
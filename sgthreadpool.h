@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.cactus
+ */
+
+#ifndef _SGTHREADPOOL_H
+#define _SGTHREADPOOL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+/*
+ * Minimal (pthreads) helper to run the same task over a range of indexes
+ * using several threads.  The calling thread always takes part as thread 0,
+ * so code that keeps one resource per thread (ie a HAL handle) can use
+ * its existing resource for index 0 and only needs extras for 1..n-1.
+ *
+ * The order in which indexes are processed is not defined, so any results
+ * need to be stored by index and merged by the caller to keep output
+ * deterministic.  start() / wait() instead run the task in the background
+ * on the extra threads only, leaving the caller free to consume results
+ * as they are produced.
+ */
+class SGThreadPool
+{
+public:
+
+   /** Work item.  run() is called exactly once for every index */
+   class Task
+   {
+   public:
+      virtual ~Task() {}
+      virtual void run(size_t index, size_t threadIdx) = 0;
+   };
+
+   SGThreadPool(size_t numThreads = 1);
+   ~SGThreadPool();
+
+   void setNumThreads(size_t numThreads);
+   size_t getNumThreads() const;
+
+   /** Run task on every index in [0, numItems) and wait for all of them
+    * to finish.  If any call throws, the remaining indexes are skipped and
+    * a hal_exception with the (first) error message is thrown here. */
+   void parallelFor(size_t numItems, Task* task);
+
+   /** Same as parallelFor() except that only the extra threads 
+    * (1..numThreads-1) work on the task, in the background.  The calling
+    * thread is free to consume their results, and must call wait() 
+    * once done.  Requires at least 2 threads. */
+   void start(size_t numItems, Task* task);
+
+   /** Wait for all threads started by start() to finish.  Throws 
+    * like parallelFor() if any call to run() failed */
+   void wait();
+
+protected:
+
+   void startThreads(size_t numItems, Task* task, size_t numThreads);
+   static void* threadMain(void* arg);
+   void work(size_t threadIdx);
+   /** Record the first error (thread safe) */
+   void setFailed(const std::string& error);
+
+protected:
+
+   size_t _numThreads;
+
+   // state of the current parallelFor() or start() call
+   Task* _task;
+   size_t _numItems;
+   size_t _next;
+   bool _failed;
+   std::string _error;
+   pthread_mutex_t _mutex;
+
+   struct ThreadArg
+   {
+      SGThreadPool* _pool;
+      size_t _threadIdx;
+   };
+   std::vector<pthread_t> _threads;
+   std::vector<ThreadArg> _args;
+};
+
+inline size_t SGThreadPool::getNumThreads() const
+{
+  return _numThreads;
+}
+
+#endif
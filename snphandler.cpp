@@ -5,36 +5,31 @@
  */
 
 #include <limits>
+#include <algorithm>
 #include <cctype>
 #include <cstdio>
-#include <sstream>
+#include <stdint.h>
 
 #include "snphandler.h"
+#include "dnakernel.h"
 
 using namespace std;
 using namespace hal;
 
 SNPHandler::SNPHandler(SideGraph* sideGraph, bool caseSensitive,
                        bool onlySequenceNames)
-  :  _caseSens(caseSensitive), _sg(sideGraph), _snpCount(0),
-     _onlySequenceNames(onlySequenceNames)
+  :  _caseSens(caseSensitive), _numPositions(0), _cursor(this),
+     _sg(sideGraph), _snpCount(0),
+     _onlySequenceNames(onlySequenceNames), _stripNames(false),
+     _dnaStore(NULL), _seqNames(NULL),
+     _nameSequence(NULL), _numScratchAllocations(0)
 {
 
 }
 
 SNPHandler::~SNPHandler()
 {
-  // simple way of making sure we don't delete same pointer twice:
-  // add to a set first.
-  set<SNPList*> snpSet;
-  for (SNPMap::iterator i = _snpMap.begin(); i != _snpMap.end(); ++i)
-  {
-    snpSet.insert(i->second);
-  }
-  for (set<SNPList*>::iterator i = snpSet.begin(); i != snpSet.end(); ++i)
-  {
-    delete *i;
-  }
+
 }
 
 pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
@@ -69,21 +64,38 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
   bool tranReverseMap = blockReverseMap != sgReverseMap;
 
   // run of positions starting from sgPos going forward in side graph
-  vector<SGPosition> sgPositions(dnaLength);
-  
-  // note : should use hints / cache to speed up consecutive bases
-  // but start simple for baseline tests
+  // (scratch buffers are kept between calls so there's nothing to
+  // allocate once they are big enough)
+  growScratch(_sgPositions, dnaLength);
+  _sgPositions.resize(dnaLength);
+  vector<SGPosition>& sgPositions = _sgPositions;
 
   // first we use the snp structure to find out if any of the SNPs we
-  // want to add already exist.  If they do, we update sgPositions
+  // want to add already exist.  If they do, we update sgPositions.
+  // bases that match the side graph map straight onto it.  we remember
+  // the side graph base so its baseline can be added if a new snp
+  // is created on it
+  growScratch(_sgVals, dnaLength);
+  _sgVals.assign(dnaLength, 'N');
+  string& sgVals = _sgVals;
   SGPosition sgCur(sgPos);
+  Cursor cursor(this, sgPos);
   for (sg_int_t i = 0; i < dnaLength; ++i)
   {
-    // sgCur is our position in the sidegraph (note that sgPos will be
+    // cursor is our position in the sidegraph (note that sgPos will be
     // last point in current interface in reversed)
-    sg_int_t sgDelta = !tranReverseMap ? i : -i;
-    sgCur.setPos(sgPos.getPos() + sgDelta);
-    assert(sgCur.getPos() >= 0);
+    if (i > 0)
+    {
+      if (!tranReverseMap)
+      {
+        cursor.toNext();
+      }
+      else
+      {
+        cursor.toPrev();
+      }
+    }
+    assert(cursor.getPosition().getPos() >= 0);
 
     // srcVal is our corresponding src position
     // (when we reverse mapping, we're actually setting a position
@@ -91,7 +103,7 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
     // -- very confusing).
     hal_index_t srcIdx =  dnaOffset + i;
     char srcVal = !tranReverseMap ? srcDNA[srcIdx] :
-       reverseComplement(srcDNA[srcIdx]);
+       complementDNA(srcDNA[srcIdx]);
 
     // which maps to this position in the target (based on original
     // source position, not reversed srcVal)
@@ -103,25 +115,20 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
     // which maps to this position in the sidegraph
     hal_index_t sgIdx = tgtIdx;
     char sgVal = !sgReverseMap ? tgtDNA[sgIdx] :
-       reverseComplement(tgtDNA[sgIdx]);
+       complementDNA(tgtDNA[sgIdx]);
 /*
     cout << "  i=" << i <<" srcIDx=" << srcIdx << "," << srcVal
          << " tgtIdx=" << tgtIdx << "," << tgtVal
          << " sgIdx=" << sgIdx << "," << sgVal
          << endl;
 */
-  
-    // add a baseline snp for (forward) value in the side graph
-    if (findSNP(sgCur, sgVal) == SideGraph::NullPos)
+    sgVals[i] = sgVal;
+    if (isSub(srcVal, sgVal) == false)
     {
-      /*
-       cout << "addbaseline -> " << sgCur << " = " << sgVal << " -> " << sgCur
-         << endl;
-      */
-      addSNP(sgCur, sgVal, sgCur);
+      sgPositions[i] = cursor.getPosition();
+      continue;
     }
-
-    sgPositions[i] = findSNP(sgCur, srcVal);
+    sgPositions[i] = cursor.findSNP(srcVal);
     /*
     cout << "sgPositions[" << i << "] = findSnp(" <<sgCur <<","
          <<srcVal <<") =" << sgPositions[i] << endl;
@@ -133,9 +140,11 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
   // cover them.  We create the sequences here and add them
   // to the side graph.  We also update sgPositions with these new
   // coordinates.
-  set<sg_int_t> newSnpSeqs;
+  // new sequences get consecutive ids from here on
+  sg_int_t firstNewSeqID = _sg->getNumSequences();
   SGSide prevHook;
-  string nameBuf;
+  string& snpDNA = _snpDNA;
+  growScratch(snpDNA, dnaLength);
   
   for (sg_int_t i = 0; i < dnaLength; ++i)
   {
@@ -144,11 +153,21 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
       sg_int_t j = i + 1;
       for (; j < dnaLength && sgPositions[j] == SideGraph::NullPos; ++j);
       --j;
-      getSNPName(halSrcSequence, srcPos, i, j - i + 1, tranReverseMap, nameBuf);
+      _nameBuf.clear();
+      if (_seqNames == NULL && _stripNames == false)
+      {
+        getSNPName(halSrcSequence, srcPos, i, j - i + 1, tranReverseMap,
+                   _nameBuf);
+      }
       const SGSequence* newSeq;
-      newSeq = _sg->addSequence(new SGSequence(-1, j - i + 1, nameBuf));
+      newSeq = _sg->addSequence(new SGSequence(-1, j - i + 1, _nameBuf));
+      assert(newSeq->getID() >= firstNewSeqID);
+      if (_seqNames != NULL && _stripNames == false)
+      {
+        _seqNames->setOrigin(newSeq->getID(), halSrcSequence,
+                             srcPos.getPos() + i, j - i + 1);
+      }
       _snpCount += newSeq->getLength();
-      newSnpSeqs.insert(newSeq->getID());
 
       // note: hooks interface no longer needed -- need to clean everywhere!
       if (!tranReverseMap)
@@ -171,7 +190,7 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
         hal_index_t srcIdx = !tranReverseMap ? dnaOffset + k :
            dnaOffset + j - (k - i);
         char srcVal = !tranReverseMap ? srcDNA[srcIdx] :
-           reverseComplement(srcDNA[srcIdx]);
+           complementDNA(srcDNA[srcIdx]);
 
         /*
         cout << "k=" << k << " dnaOffset=" << dnaOffset << " i=" << i
@@ -183,12 +202,27 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
         // forward map sg to new sequence
         sgPositions[k].setSeqID(newSeq->getID());
         sgPositions[k].setPos(k - i);
+
+        // add a baseline snp for (forward) value in the side graph
+        // if it's the first snp here
+        char sgVal = sgVals[!tranReverseMap ? sgDelta : -sgDelta];
+        if (findSNP(sgCur, sgVal) == SideGraph::NullPos)
+        {
+          addSNP(sgCur, sgVal, sgCur);
+        }
         /*
           cout << "addnew -> " << sgCur << " = " << srcVal << " -> "
           << sgPositions[k] << endl;
         */
         addSNP(sgCur, srcVal, sgPositions[k]);
+        snpDNA.push_back(srcVal);
       }
+
+      if (_dnaStore != NULL)
+      {
+        _dnaStore->add(newSeq->getID(), snpDNA);
+      }
+      snpDNA.clear();
       
       i = j;
     }
@@ -218,8 +252,7 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
 
     srcLookup->addInterval(pos, sgPositions[i], j - i, tranReverseMap);
 
-    if (seqMapBack != NULL &&
-        newSnpSeqs.find(sgPositions[i].getSeqID()) != newSnpSeqs.end())
+    if (seqMapBack != NULL && sgPositions[i].getSeqID() >= firstNewSeqID)
     {
       // keep record of where it came from (ie to trace back from the side
       // graph to hal (only made optional to let unit tests skip this step
@@ -240,7 +273,7 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
   pair<SGSide, SGSide> outHooks;
   outHooks.first.setBase(sgPositions[0]);
   outHooks.first.setForward(false);
-  outHooks.second.setBase(sgPositions[sgPositions.size() - 1]);
+  outHooks.second.setBase(sgPositions[dnaLength - 1]);
   outHooks.second.setForward(true);
   
   return outHooks;
@@ -248,31 +281,28 @@ pair<SGSide, SGSide> SNPHandler::createSNP(const string& srcDNA,
 
 const SGPosition& SNPHandler::findSNP(const SGPosition& pos, char nuc)
 {
-  if (_caseSens == false)
-  {
-    nuc = toupper(nuc);
-  }
-  
-  if (pos != _cachePos)
+  _cursor.toPosition(pos);
+  return _cursor.findSNP(nuc);
+}
+
+const SGPosition& SNPHandler::getPrevSNP(char nuc)
+{
+  if (_cursor.getPosition() == SideGraph::NullPos)
   {
-    pair<SNPMap::iterator, bool> ins = _snpMap.insert(
-      pair<SGPosition, SNPList*>(pos, NULL));
-    _cacheIt = ins.first;
-    _cachePos = pos;
+    throw hal_exception("getPrevSNP called before findSNP");
   }
+  _cursor.toPrev();
+  return _cursor.findSNP(nuc);
+}
 
-  SNPList* snpList = _cacheIt->second;
-  if (snpList != NULL)
+const SGPosition& SNPHandler::getNextSNP(char nuc)
+{
+  if (_cursor.getPosition() == SideGraph::NullPos)
   {
-    for (SNPList::iterator i = snpList->begin(); i != snpList->end(); ++i)
-    {
-      if (i->_nuc == nuc)
-      {
-        return i->_pos;
-      }
-    }
+    throw hal_exception("getNextSNP called before findSNP");
   }
-  return SideGraph::NullPos;
+  _cursor.toNext();
+  return _cursor.findSNP(nuc);
 }
 
 void SNPHandler::addSNP(const SGPosition& pos, char nuc,
@@ -287,42 +317,209 @@ void SNPHandler::addSNP(const SGPosition& pos, char nuc,
     nuc = toupper(nuc);
   }
          
-  if (pos != _cachePos)
+  _cursor.toPosition(pos);
+  if (_cursor._site < 0)
   {
-    pair<SNPMap::iterator, bool> ins = _snpMap.insert(
-      pair<SGPosition, SNPList*>(pos, NULL));
-    _cacheIt = ins.first;
-    _cachePos = pos;
+    _cursor._site = _sites.size();
+    _sites.push_back(SNPSite());
+    insertSite(pos, _cursor._site);
   }
-  if (_cacheIt->second == NULL)
+
+  // append to the last site of the chain, starting a new one if full
+  sg_int_t site = _cursor._site;
+  while (_sites[site]._next >= 0)
   {
-    _cacheIt->second = new SNPList();
+    site = _sites[site]._next;
   }
-  
-  SNPList* snpList = _cacheIt->second;
-  snpList->push_back(SNP(snpPosition, nuc));
+  if (_sites[site]._size == SiteSize)
+  {
+    _sites[site]._next = _sites.size();
+    site = _sites.size();
+    _sites.push_back(SNPSite());
+  }
+  SNPSite& snpSite = _sites[site];
+  snpSite._pos[snpSite._size] = snpPosition;
+  snpSite._nuc[snpSite._size] = nuc;
+  ++snpSite._size;
 
   // add new position into the handler
   if (pos != snpPosition)
   {
-    assert(_snpMap.find(snpPosition) == _snpMap.end());
-    _snpMap.insert(pair<SGPosition, SNPList*>(snpPosition, snpList));
+    assert(findSite(snpPosition) < 0);
+    insertSite(snpPosition, _cursor._site);
+  }
+}
+
+bool SNPHandler::getSNPAnchor(const SGPosition& pos, char& outNuc,
+                              SGPosition& outAnchor, char& outAnchorNuc) const
+{
+  // the first SNP in a site is always the baseline added on the
+  // position where the bubble was created (see createSNP())
+  sg_int_t site = findSite(pos);
+  if (site < 0 || _sites[site]._pos[0] == pos)
+  {
+    return false;
+  }
+  outAnchor = _sites[site]._pos[0];
+  outAnchorNuc = _sites[site]._nuc[0];
+  for (; site >= 0; site = _sites[site]._next)
+  {
+    const SNPSite& snpSite = _sites[site];
+    for (size_t i = 0; i < snpSite._size; ++i)
+    {
+      if (snpSite._pos[i] == pos)
+      {
+        outNuc = snpSite._nuc[i];
+        return true;
+      }
+    }
+  }
+  assert(false);
+  return false;
+}
+
+SNPHandler::Cursor::Cursor(const SNPHandler* handler, const SGPosition& pos)
+  : _handler(handler), _pos(pos), _site(-1)
+{
+  if (_handler != NULL && _pos != SideGraph::NullPos)
+  {
+    _site = _handler->findSite(_pos);
+  }
+}
+
+void SNPHandler::Cursor::toPosition(const SGPosition& pos)
+{
+  if (pos != _pos)
+  {
+    _pos = pos;
+    _site = _handler->findSite(_pos);
   }
 }
 
+void SNPHandler::Cursor::toNext()
+{
+  _pos.setPos(_pos.getPos() + 1);
+  _site = _handler->findSite(_pos);
+}
+
+void SNPHandler::Cursor::toPrev()
+{
+  _pos.setPos(_pos.getPos() - 1);
+  _site = _handler->findSite(_pos);
+}
+
+const SGPosition& SNPHandler::Cursor::findSNP(char nuc) const
+{
+  if (_handler->_caseSens == false)
+  {
+    nuc = toupper(nuc);
+  }
+  for (sg_int_t site = _site; site >= 0; 
+       site = _handler->_sites[site]._next)
+  {
+    const SNPSite& snpSite = _handler->_sites[site];
+    for (size_t i = 0; i < snpSite._size; ++i)
+    {
+      if (snpSite._nuc[i] == nuc)
+      {
+        return snpSite._pos[i];
+      }
+    }
+  }
+  return SideGraph::NullPos;
+}
+
+sg_int_t SNPHandler::findSite(const SGPosition& pos) const
+{
+  if (_slots.empty())
+  {
+    return -1;
+  }
+  size_t mask = _slots.size() - 1;
+  for (size_t i = hashPosition(pos) & mask; _slots[i]._site >= 0;
+       i = (i + 1) & mask)
+  {
+    if (_slots[i]._pos == pos)
+    {
+      return _slots[i]._site;
+    }
+  }
+  return -1;
+}
+
+void SNPHandler::insertSite(const SGPosition& pos, sg_int_t site)
+{
+  // keep the table at most half full
+  if (2 * (_numPositions + 1) > _slots.size())
+  {
+    rehash(max(2 * _slots.size(), (size_t)1024));
+  }
+  size_t mask = _slots.size() - 1;
+  size_t i = hashPosition(pos) & mask;
+  while (_slots[i]._site >= 0)
+  {
+    assert(_slots[i]._pos != pos);
+    i = (i + 1) & mask;
+  }
+  _slots[i]._pos = pos;
+  _slots[i]._site = site;
+  ++_numPositions;
+}
+
+void SNPHandler::rehash(size_t numSlots)
+{
+  assert((numSlots & (numSlots - 1)) == 0);
+  vector<SNPSlot> oldSlots(numSlots);
+  oldSlots.swap(_slots);
+  size_t mask = numSlots - 1;
+  for (size_t j = 0; j < oldSlots.size(); ++j)
+  {
+    if (oldSlots[j]._site >= 0)
+    {
+      size_t i = hashPosition(oldSlots[j]._pos) & mask;
+      while (_slots[i]._site >= 0)
+      {
+        i = (i + 1) & mask;
+      }
+      _slots[i] = oldSlots[j];
+    }
+  }
+}
+
+size_t SNPHandler::hashPosition(const SGPosition& pos)
+{
+  // hash blocks of consecutive positions, keeping their order inside
+  // the block, so a Cursor walking along a sequence probes neighbouring
+  // slots
+  uint64_t pos64 = (uint64_t)pos.getPos();
+  uint64_t h = (uint64_t)pos.getSeqID() * 0x9E3779B97F4A7C15ULL + 
+     pos64 / HashBlockSize;
+  h ^= h >> 31;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 29;
+  return (size_t)(h * HashBlockSize + pos64 % HashBlockSize);
+}
+
 void SNPHandler::getSNPName(const Sequence* halSrcSequence,
                             const SGPosition& srcPos,
                             sg_int_t offset, sg_int_t length,
-                            bool reverseMap, string& outName) const
+                            bool reverseMap, string& outName)
 {
-  stringstream ss;
-  if (halSrcSequence != NULL)
+  // same as streaming name << "_" << pos << "_" << length, but without
+  // making a stringstream (and the sequence name) every time
+  if (halSrcSequence != _nameSequence)
   {
-    // unit tests sometimes dont bother with a hal sequence so we
-    // let it be optional here. 
-    ss << (_onlySequenceNames ? halSrcSequence->getName() :
-           halSrcSequence->getFullName());
+    _nameSequence = halSrcSequence;
+    _namePrefix.clear();
+    if (halSrcSequence != NULL)
+    {
+      // unit tests sometimes dont bother with a hal sequence so we
+      // let it be optional here. 
+      _namePrefix = _onlySequenceNames ? halSrcSequence->getName() :
+         halSrcSequence->getFullName();
+    }
   }
-  ss << "_" << (srcPos.getPos() + offset) << "_" << length;
-  outName = ss.str();
+  growScratch(outName, _namePrefix.length() + SGSeqNames::MaxRangeLength);
+  outName.assign(_namePrefix);
+  SGSeqNames::appendRange(outName, srcPos.getPos() + offset, length);
 }
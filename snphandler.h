@@ -7,12 +7,16 @@
 #ifndef _SNPHANDLER_H
 #define _SNPHANDLER_H
 
-#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
 
 #include "sglookup.h"
 #include "sglookback.h"
 #include "sidegraph.h"
 #include "sgbuilder.h"
+#include "packeddna.h"
+#include "sgseqnames.h"
 /**
  * Structure to link a position in a sidegraph with alternate bases
  * ie to represent point mutations in the hal.  These mutations
@@ -26,12 +30,16 @@
  * if we need to make a new sequence, or if a sequence containing that 
  * base is already there for us to hook into. 
  *
- * We only keep a SNP list at positions where there is a snp.  
+ * We only keep a SNP site at positions where there is a snp.  
  * And for now we use a single SNP handler to index all SNPs in the graph.
  *
  * Also, note that multiple positions in the side graph can correspond
  * to the same SNP alignment.  In this case these positions will all
- * map to the same SNPList pointer. 
+ * map to the same site.  Sites are stored in a flat array and positions
+ * are mapped to their index with an open addressing hash table, so there
+ * is no allocation per SNP.  Each site holds up to SiteSize alleles
+ * inline, linking to overflow sites for any more (ie case sensitive or
+ * non ACGTN bases). 
  *
  */
 class SNPHandler
@@ -70,17 +78,53 @@ public:
    void addSNP(const SGPosition& pos, char nuc,
                const SGPosition& snpPosition);
 
-   /** Get previous SNP position in map in relation to last call to 
-    * findSNP.  Saves a lookup if we want to check a series of 
-    * contiguous positions, for example.  throws an exception if
-    * there is not last position. 
+   /** Check for a SNP at the base before the position of the last call
+    * to findSNP (or getPrevSNP / getNextSNP).  Handy for checking a 
+    * series of contiguous positions, for example.  throws an exception
+    * if there is no last position. 
     */
-   const SGPosition& getPrevSNP() const;
+   const SGPosition& getPrevSNP(char nuc);
 
-   /** Get next SNP position in map in relation to last call to 
-    * findSNP 
+   /** Check for a SNP at the base after the position of the last call
+    * to findSNP (or getPrevSNP / getNextSNP)
     */
-   const SGPosition& getNextSNP() const;
+   const SGPosition& getNextSNP(char nuc);
+
+   /** Read-only position in the SNP index, that can be stepped along a 
+    * side graph sequence one base at a time.  Consecutive positions are
+    * hashed to neighbouring slots so each step is a probe of memory that
+    * is most likely cached already.  Any number of cursors can be used
+    * from different threads as long as no SNPs are added meanwhile.  A 
+    * cursor doesn't see SNPs added at its position until it moves.
+    */
+   class Cursor
+   {
+   public:
+      Cursor(const SNPHandler* handler = NULL,
+             const SGPosition& pos = SideGraph::NullPos);
+      void toPosition(const SGPosition& pos);
+      void toNext();
+      void toPrev();
+      const SGPosition& getPosition() const;
+      /** Is there a SNP (or baseline) at the position */
+      bool hasSNP() const;
+      /** Same as SNPHandler::findSNP() at the position */
+      const SGPosition& findSNP(char nuc) const;
+   protected:
+      friend class SNPHandler;
+      const SNPHandler* _handler;
+      SGPosition _pos;
+      sg_int_t _site;
+   };
+   friend class Cursor;
+
+   /** Look up a position that was added as a SNP (ie it is in a sequence
+    * created by createSNP).  Get the base it represents along with the
+    * position (and base) of the original sequence the bubble was created
+    * on.  Returns false if pos is not such a position.
+    */
+   bool getSNPAnchor(const SGPosition& pos, char& outNuc,
+                     SGPosition& outAnchor, char& outAnchorNuc) const;
 
    /** Get the total length of SNP sequence created (for debugging)
     */
@@ -90,6 +134,31 @@ public:
     */
    bool isSub(char c1, char c2) const;
 
+   /** Is isSub() case sensitive?
+    */
+   bool isCaseSensitive() const;
+
+   /** Record the bases of each sequence created by createSNP() in 
+    * dnaStore (NULL to not bother)
+    */
+   void setDNAStore(PackedDNAStore* dnaStore);
+
+   /** Don't name the sequences created by createSNP(), just record 
+    * where they come from in seqNames (NULL to name them right away)
+    */
+   void setSeqNames(SGSeqNames* seqNames);
+
+   /** Leave the sequences created by createSNP() without names (not
+    * recording them in seqNames either)
+    */
+   void setStripNames(bool stripNames);
+
+   /** Number of times one of the scratch buffers used by createSNP() 
+    * had to grow.  Once they are big enough for the longest SNP run 
+    * (and name) it stops changing.
+    */
+   size_t getNumScratchAllocations() const;
+
 protected:
 
    /** Make a name for the SNP using the coordinate in the SRC
@@ -97,34 +166,86 @@ protected:
    void getSNPName(const hal::Sequence* halSrcSequence,
                    const SGPosition& srcPos,
                    sg_int_t offset, sg_int_t length,
-                   bool reverseMap, std::string& outName) const;
+                   bool reverseMap, std::string& outName);
+
+   /** Make sure a scratch buffer can hold length elements, counting 
+    * every time it has to grow */
+   template <typename T>
+   void growScratch(T& buffer, size_t length);
    
-   struct SNP
+   /** Index of the site of a position in _sites (-1 if none) */
+   sg_int_t findSite(const SGPosition& pos) const;
+
+   /** Add position to the hash table, pointing to site */
+   void insertSite(const SGPosition& pos, sg_int_t site);
+
+   /** Grow the hash table to numSlots (a power of 2) */
+   void rehash(size_t numSlots);
+
+   static size_t hashPosition(const SGPosition& pos);
+
+   static const size_t SiteSize = 5;
+   static const size_t HashBlockSize = 8;
+
+   /** The alleles at a position, the first being the baseline of the
+    * position they were created on.  Overflow alleles are stored in the
+    * site _next */
+   struct SNPSite
    {
-      SNP();
-      SNP(const SGPosition& pos, char nuc);
-      SGPosition _pos;
-      char _nuc;
+      SNPSite();
+      SGPosition _pos[SiteSize];
+      char _nuc[SiteSize];
+      unsigned char _size;
+      sg_int_t _next;
    };
 
-   typedef std::vector<SNP> SNPList;
-   typedef std::map<SGPosition, SNPList*> SNPMap;
+   /** Hash table entry (empty if _site is -1) */
+   struct SNPSlot
+   {
+      SNPSlot();
+      SGPosition _pos;
+      sg_int_t _site;
+   };
    
 protected:
 
    bool _caseSens;
-   SNPMap _snpMap;
-   SNPMap::iterator _cacheIt;
-   SGPosition _cachePos;
+   std::vector<SNPSite> _sites;
+   std::vector<SNPSlot> _slots;
+   size_t _numPositions;
+   // last position looked up (shortcut for consecutive calls)
+   Cursor _cursor;
    SideGraph* _sg;
    size_t _snpCount;
    bool _onlySequenceNames;
+   bool _stripNames;
+   PackedDNAStore* _dnaStore;
+   SGSeqNames* _seqNames;
+
+   // scratch buffers for createSNP()
+   std::vector<SGPosition> _sgPositions;
+   std::string _sgVals;
+   std::string _snpDNA;
+   std::string _nameBuf;
+   // name of the last sequence passed to getSNPName()
+   const hal::Sequence* _nameSequence;
+   std::string _namePrefix;
+   size_t _numScratchAllocations;
 };
 
 
-inline SNPHandler::SNP::SNP() {}
-inline SNPHandler::SNP::SNP(const SGPosition& pos, char nuc) :
-  _pos(pos), _nuc(nuc){}
+inline SNPHandler::SNPSite::SNPSite() : _size(0), _next(-1) {}
+inline SNPHandler::SNPSlot::SNPSlot() : _site(-1) {}
+
+inline const SGPosition& SNPHandler::Cursor::getPosition() const
+{
+  return _pos;
+}
+
+inline bool SNPHandler::Cursor::hasSNP() const
+{
+  return _site >= 0;
+}
 
 inline sg_int_t SNPHandler::getSNPCount() const
 {
@@ -135,4 +256,39 @@ inline bool SNPHandler::isSub(char c1, char c2) const
 {
   return _caseSens ? c1 != c2 : std::toupper(c1) != std::toupper(c2);
 }
+
+inline bool SNPHandler::isCaseSensitive() const
+{
+  return _caseSens;
+}
+
+inline void SNPHandler::setDNAStore(PackedDNAStore* dnaStore)
+{
+  _dnaStore = dnaStore;
+}
+
+inline void SNPHandler::setSeqNames(SGSeqNames* seqNames)
+{
+  _seqNames = seqNames;
+}
+
+inline void SNPHandler::setStripNames(bool stripNames)
+{
+  _stripNames = stripNames;
+}
+
+inline size_t SNPHandler::getNumScratchAllocations() const
+{
+  return _numScratchAllocations;
+}
+
+template <typename T>
+inline void SNPHandler::growScratch(T& buffer, size_t length)
+{
+  if (buffer.capacity() < length)
+  {
+    buffer.reserve(std::max(length, 2 * buffer.capacity()));
+    ++_numScratchAllocations;
+  }
+}
 #endif
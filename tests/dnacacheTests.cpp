@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "halAlignmentTest.h"
+#include "unitTests.h"
+#include "dnacache.h"
+
+using namespace std;
+using namespace hal;
+
+struct DNACacheTest : public AlignmentTest
+{
+   void createCallBack(hal::AlignmentPtr alignment);
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void DNACacheTest::createCallBack(AlignmentPtr alignment)
+{
+  Genome* genome = alignment->addRootGenome("Genome", 0);
+  vector<Sequence::Info> seqVec(2);
+  seqVec[0] = Sequence::Info("Sequence1", 5 * DNACache::PageSize + 17, 0, 0);
+  seqVec[1] = Sequence::Info("Sequence2", 1000, 0, 0);
+  genome->setDimensions(seqVec);
+
+  const char bases[] = "ACGTNacgtn";
+  string dna(genome->getSequenceLength(), 'A');
+  for (size_t i = 0; i < dna.length(); ++i)
+  {
+    dna[i] = bases[rand() % 10];
+  }
+  genome->setString(dna);
+}
+
+void DNACacheTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  const Genome* genome = alignment->openGenome("Genome");
+  const Sequence* sequences[] = {genome->getSequence("Sequence1"),
+                                 genome->getSequence("Sequence2")};
+  
+  // room for 2 pages, so plenty of evictions
+  DNACache cache(2 * DNACache::PageSize);
+  string dna;
+  string cachedDNA;
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    const Sequence* sequence = sequences[i % 2];
+    hal_index_t seqLen = sequence->getSequenceLength();
+    hal_index_t pos = rand() % seqLen;
+    hal_index_t length = rand() % min(seqLen - pos + 1, 
+                                      2 * DNACache::PageSize);
+    sequence->getSubString(dna, pos, length);
+    cache.getSubString(sequence, sequence, pos, length, cachedDNA);
+    CuAssertTrue(_testCase, cachedDNA == dna);
+  }
+  CuAssertTrue(_testCase, cache.getNumHits() > 0);
+  CuAssertTrue(_testCase, cache.getNumMisses() > 2);
+
+  // whole sequence, twice: second time is all hits
+  const Sequence* sequence = sequences[0];
+  hal_index_t seqLen = sequence->getSequenceLength();
+  cache.setMaxBytes(seqLen);
+  sequence->getString(dna);
+  cache.getSubString(sequence, sequence, 0, seqLen, cachedDNA);
+  CuAssertTrue(_testCase, cachedDNA == dna);
+  CuAssertTrue(_testCase, cache.getNumHits() == 0);
+  CuAssertTrue(_testCase, cache.getNumMisses() == 6);
+  cache.getSubString(sequence, sequence, 0, seqLen, cachedDNA);
+  CuAssertTrue(_testCase, cachedDNA == dna);
+  CuAssertTrue(_testCase, cache.getNumHits() == 6);
+  CuAssertTrue(_testCase, cache.getNumMisses() == 6);
+
+  // disabled
+  cache.setMaxBytes(0);
+  cache.getSubString(sequence, sequence, 10, 100, cachedDNA);
+  CuAssertTrue(_testCase, cachedDNA == dna.substr(10, 100));
+  CuAssertTrue(_testCase, cache.getNumHits() == 0 &&
+               cache.getNumMisses() == 0);
+}
+
+void dnaCacheTest(CuTest *testCase)
+{
+  try
+  {
+    DNACacheTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+struct RootDNACacheTest : public AlignmentTest
+{
+   void createCallBack(hal::AlignmentPtr alignment);
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+   string _dna;
+};
+
+void RootDNACacheTest::createCallBack(AlignmentPtr alignment)
+{
+  Genome* ancGenome = alignment->addRootGenome("AncGenome", 0);
+  Genome* leafGenome = alignment->addLeafGenome("Leaf1", "AncGenome", 0.1);
+
+  // 2 root sequences of 10 segments each
+  vector<Sequence::Info> seqVec(2);
+  seqVec[0] = Sequence::Info("AncSequence1", 100, 0, 10);
+  seqVec[1] = Sequence::Info("AncSequence2", 100, 0, 10);
+  ancGenome->setDimensions(seqVec);
+  seqVec[0] = Sequence::Info("LeafSequence1", 100, 10, 0);
+  seqVec[1] = Sequence::Info("LeafSequence2", 100, 10, 0);
+  leafGenome->setDimensions(seqVec);
+
+  // CAMEL style: the root is all N and the leaf has the DNA, 
+  // with segment 5 inverted
+  const char bases[] = "ACGTacgt";
+  _dna.resize(ancGenome->getSequenceLength());
+  for (size_t i = 0; i < _dna.length(); ++i)
+  {
+    _dna[i] = bases[rand() % 8];
+  }
+  ancGenome->setString(string(_dna.length(), 'N'));
+  string leafDNA = _dna.substr(0, 50);
+  string temp = _dna.substr(50, 10);
+  reverseComplement(temp);
+  leafDNA += temp;
+  leafDNA += _dna.substr(60);
+  leafGenome->setString(leafDNA);
+
+  TopSegmentIteratorPtr top = leafGenome->getTopSegmentIterator();
+  BottomSegmentIteratorPtr bottom = ancGenome->getBottomSegmentIterator();
+  for (size_t i = 0; i < ancGenome->getNumBottomSegments(); ++i)
+  {
+    bool reversed = i == 5;
+    bottom->bseg()->setTopParseIndex(NULL_INDEX);
+    bottom->bseg()->setChildIndex(0, i);
+    bottom->bseg()->setChildReversed(0, reversed);
+    bottom->bseg()->setCoordinates(i * 10, 10);
+    top->tseg()->setBottomParseIndex(NULL_INDEX);
+    top->tseg()->setParentIndex(i);
+    top->tseg()->setCoordinates(i * 10, 10);
+    top->tseg()->setParentReversed(reversed);
+    top->tseg()->setNextParalogyIndex(NULL_INDEX);
+    bottom->toRight();
+    top->toRight();
+  }
+}
+
+void RootDNACacheTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+  const Genome* ancGenome = alignment->openGenome("AncGenome");
+  const Sequence* sequences[] = {ancGenome->getSequence("AncSequence1"),
+                                 ancGenome->getSequence("AncSequence2")};
+  // whole genome fits in a page, so also check with the cache disabled
+  // to infer ranges that don't start and end on a page
+  RootDNACache cache(DNACache::PageSize);
+  RootDNACache uncached(0);
+  RootDNACache* caches[] = {&cache, &uncached};
+  string cachedDNA;
+  for (size_t c = 0; c < 2; ++c)
+  {
+    for (size_t i = 0; i < 1000; ++i)
+    {
+      const Sequence* sequence = sequences[i % 2];
+      hal_index_t seqLen = sequence->getSequenceLength();
+      hal_index_t pos = rand() % seqLen;
+      hal_index_t length = rand() % (seqLen - pos + 1);
+      caches[c]->getSubString(sequence, sequence, pos, length, cachedDNA);
+      CuAssertTrue(_testCase, cachedDNA == _dna.substr(
+                     sequence->getStartPosition() + pos, length));
+    }
+  }
+  // one page per sequence
+  CuAssertTrue(_testCase, cache.getNumMisses() == 2);
+}
+
+void rootDNACacheTest(CuTest *testCase)
+{
+  try
+  {
+    RootDNACacheTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+CuSuite* dnaCacheTestSuite(void) 
+{
+  CuSuite* suite = CuSuiteNew();
+  SUITE_ADD_TEST(suite, dnaCacheTest);
+  SUITE_ADD_TEST(suite, rootDNACacheTest);
+  return suite;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+#include <vector>
+#include "unitTests.h"
+#include "hal.h"
+#include "dnakernel.h"
+
+using namespace std;
+using namespace hal;
+
+static const char testAlphabet[] = "ACGTacgtNnRYKMSWrykmsw-.";
+
+static void randomDNA(string& outDNA, size_t length, size_t alphabetSize)
+{
+  outDNA.resize(length);
+  for (size_t i = 0; i < length; ++i)
+  {
+    outDNA[i] = testAlphabet[rand() % alphabetSize];
+  }
+}
+
+// one base at a time, as done in SGBuilder::mapBlockBody originally
+static void simpleMismatchRuns(const string& src, const string& tgt,
+                               bool reversed, bool caseSensitive,
+                               vector<DNAMismatchRun>& outRuns)
+{
+  outRuns.clear();
+  size_t length = src.length();
+  for (size_t i = 0; i < length; ++i)
+  {
+    char tgtVal = !reversed ? tgt[i] : reverseComplement(tgt[length - 1 - i]);
+    bool snp = caseSensitive ? src[i] != tgtVal :
+       toupper(src[i]) != toupper(tgtVal);
+    if (snp == true)
+    {
+      if (i > 0 && outRuns.empty() == false &&
+          outRuns.back()._start + outRuns.back()._length == i)
+      {
+        ++outRuns.back()._length;
+      }
+      else
+      {
+        DNAMismatchRun run;
+        run._start = i;
+        run._length = 1;
+        outRuns.push_back(run);
+      }
+    }
+  }
+}
+
+static bool sameRuns(const vector<DNAMismatchRun>& runs1,
+                     const vector<DNAMismatchRun>& runs2)
+{
+  if (runs1.size() != runs2.size())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < runs1.size(); ++i)
+  {
+    if (runs1[i]._start != runs2[i]._start ||
+        runs1[i]._length != runs2[i]._length)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void dnaMismatchRunsTest(CuTest *testCase)
+{
+  srand(2015);
+  string src;
+  string tgt;
+  vector<DNAMismatchRun> runs;
+  vector<DNAMismatchRun> truth;
+  
+  for (size_t length = 0; length < 300; ++length)
+  {
+    for (size_t alphabetSize = 2; alphabetSize <= 24; alphabetSize += 11)
+    {
+      randomDNA(src, length, alphabetSize);
+      // mostly matching target with some case changes and snps
+      tgt = src;
+      for (size_t i = 0; i < length; ++i)
+      {
+        int r = rand() % 20;
+        if (r == 0)
+        {
+          tgt[i] = testAlphabet[rand() % alphabetSize];
+        }
+        else if (r == 1)
+        {
+          tgt[i] = islower(tgt[i]) ? toupper(tgt[i]) : tolower(tgt[i]);
+        }
+      }
+      for (size_t t = 0; t < 4; ++t)
+      {
+        bool reversed = t / 2 == 1;
+        bool caseSensitive = t % 2 == 1;
+        string curTgt = tgt;
+        if (reversed == true)
+        {
+          reverseComplement(curTgt);
+        }
+        findDNAMismatchRuns(src, curTgt, reversed, caseSensitive, runs);
+        simpleMismatchRuns(src, curTgt, reversed, caseSensitive, truth);
+        CuAssertTrue(testCase, sameRuns(runs, truth));
+      }
+    }
+  }
+
+  // completely different strings give one run
+  src = string(100, 'A');
+  tgt = string(100, 'c');
+  findDNAMismatchRuns(src, tgt, false, false, runs);
+  CuAssertTrue(testCase, runs.size() == 1);
+  CuAssertTrue(testCase, runs[0]._start == 0 && runs[0]._length == 100);
+  tgt = string(100, 'a');
+  findDNAMismatchRuns(src, tgt, false, false, runs);
+  CuAssertTrue(testCase, runs.empty());
+  findDNAMismatchRuns(src, tgt, false, true, runs);
+  CuAssertTrue(testCase, runs.size() == 1);
+}
+
+void dnaReverseComplementTest(CuTest *testCase)
+{
+  for (int c = -128; c < 128; ++c)
+  {
+    CuAssertTrue(testCase, complementDNA((char)c) == 
+                 reverseComplement((char)c));
+  }
+  
+  srand(2016);
+  for (size_t length = 0; length < 300; ++length)
+  {
+    for (size_t t = 0; t < 2; ++t)
+    {
+      string dna(length, 'N');
+      for (size_t i = 0; i < length; ++i)
+      {
+        // all byte values, or mostly dna
+        dna[i] = t == 0 ? (char)(1 + rand() % 255) :
+           testAlphabet[rand() % (sizeof(testAlphabet) - 1)];
+      }
+      string truth = dna;
+      reverseComplement(truth);
+      
+      string outOfPlace(length, 'N');
+      if (length > 0)
+      {
+        reverseComplementDNA(dna.data(), length, &outOfPlace[0]);
+      }
+      CuAssertTrue(testCase, outOfPlace == truth);
+
+      string inPlace = dna;
+      reverseComplementDNA(inPlace);
+      CuAssertTrue(testCase, inPlace == truth);
+    }
+  }
+}
+
+void dnaAllNTest(CuTest *testCase)
+{
+  srand(2017);
+  for (size_t length = 0; length < 300; ++length)
+  {
+    string dna(length, 'N');
+    for (size_t i = 0; i < length; ++i)
+    {
+      dna[i] = rand() % 2 ? 'N' : 'n';
+    }
+    CuAssertTrue(testCase, isAllN(dna.data(), length) == true);
+    if (length > 0)
+    {
+      // any other byte, anywhere
+      char c;
+      do
+      {
+        c = (char)(1 + rand() % 255);
+      } while (toupper(c) == 'N');
+      dna[rand() % length] = c;
+      CuAssertTrue(testCase, isAllN(dna.data(), length) == false);
+    }
+  }
+}
+
+CuSuite* dnaKernelTestSuite(void) 
+{
+  CuSuite* suite = CuSuiteNew();
+  SUITE_ADD_TEST(suite, dnaMismatchRunsTest);
+  SUITE_ADD_TEST(suite, dnaReverseComplementTest);
+  SUITE_ADD_TEST(suite, dnaAllNTest);
+  return suite;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "unitTests.h"
+#include "packeddna.h"
+
+using namespace std;
+
+static const char testAlphabet[] = "ACGTacgtNnRYKMSWrykmsw-.";
+
+void packedDNARoundTripTest(CuTest *testCase)
+{
+  srand(2828);
+  for (size_t t = 0; t < 100; ++t)
+  {
+    // mostly ACGT, with runs of N, IUPAC codes and soft-masking
+    size_t length = rand() % 5000;
+    string dna(length, 'A');
+    for (size_t i = 0; i < length; ++i)
+    {
+      if (rand() % 10 == 0 && i > 0)
+      {
+        dna[i] = dna[i - 1];
+      }
+      else
+      {
+        dna[i] = testAlphabet[rand() % (t % 2 == 0 ? 8 : 24)];
+      }
+    }
+
+    // add it in a few pieces to test appending across words
+    PackedDNA packedDNA;
+    for (size_t pos = 0; pos < length;)
+    {
+      size_t chunk = min(length - pos, (size_t)(rand() % 100 + 1));
+      packedDNA.append(dna.c_str() + pos, chunk);
+      pos += chunk;
+    }
+    CuAssertTrue(testCase, packedDNA.getLength() == length);
+
+    string out;
+    packedDNA.getSubString(out, 0, length);
+    CuAssertTrue(testCase, out == dna);
+    for (size_t i = 0; i < 100 && length > 0; ++i)
+    {
+      size_t pos = rand() % length;
+      size_t len = rand() % (length - pos + 1);
+      packedDNA.getSubString(out, pos, len);
+      CuAssertTrue(testCase, out == dna.substr(pos, len));
+    }
+    if (t % 2 == 0)
+    {
+      // no exceptions: 2 bits + 1 mask bit a base
+      CuAssertTrue(testCase, packedDNA.getNumBytes() == 
+                   PackedDNA::getNumBytes(length));
+    }
+  }
+}
+
+CuSuite* packedDNATestSuite(void) 
+{
+  CuSuite* suite = CuSuiteNew();
+  SUITE_ADD_TEST(suite, packedDNARoundTripTest);
+  return suite;
+}
@@ -6,12 +6,17 @@
 #include <cstdio>
 #include <cstdlib>
 #include <sstream>
+#include <fstream>
 #include <ctime>
 #include <cmath>
+#include <limits>
+#include <algorithm>
 #include <cstdio>
 #include "halAlignmentTest.h"
 #include "unitTests.h"
 #include "sgbuilder.h"
+#include "halsgsql.h"
+#include "genometreeindex.h"
 
 using namespace std;
 using namespace hal;
@@ -818,6 +823,619 @@ void sgBuilderHarderSNPTest(CuTest *testCase)
   }
 }
 
+///////////////////////////////////////////////////////////////////////////
+//
+//            CLADE MERGE TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct CladeMergeTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void CladeMergeTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  const Genome* ancGenome = alignment->openGenome("AncGenome");
+  const Genome* leaf1Genome = alignment->openGenome("Leaf1");
+  const Genome* leaf2Genome = alignment->openGenome("Leaf2");
+
+  SGBuilder serialBuild;
+  serialBuild.init(alignment, ancGenome, false, false);
+  serialBuild.addGenome(ancGenome);
+  serialBuild.addGenome(leaf1Genome);
+  serialBuild.addGenome(leaf2Genome);
+  serialBuild.computeJoins();
+  const SideGraph* serialSg = serialBuild.getSideGraph();
+
+  // leaf1 and leaf2 are in different clades under the root
+  vector<const Genome*> genomes;
+  genomes.push_back(ancGenome);
+  genomes.push_back(leaf1Genome);
+  genomes.push_back(leaf2Genome);
+  SGBuilder cladeBuild;
+  cladeBuild.init(alignment, ancGenome, false, false);
+  cladeBuild.addGenomesByClade(genomes);
+  // path consistency checked here
+  cladeBuild.computeJoins();
+  const SideGraph* cladeSg = cladeBuild.getSideGraph();
+
+  // ancestral sequences are shared
+  CuAssertTrue(_testCase, cladeSg->getSequence(0)->getLength() ==
+               serialSg->getSequence(0)->getLength());
+  CuAssertTrue(_testCase, cladeSg->getSequence(1)->getLength() ==
+               serialSg->getSequence(1)->getLength());
+  CuAssertTrue(_testCase, cladeBuild.getHalSequences().size() ==
+               serialBuild.getHalSequences().size());
+  // leaf2's snps at [3,7] only partially overlap leaf1's.  The shared
+  // bases must be merged into leaf1's bubbles, leaving the same 1 and 
+  // 2-base sequences that the serial build hooks between leaf1's snps.
+  CuAssertTrue(_testCase, cladeSg->getNumSequences() ==
+               serialSg->getNumSequences());
+  vector<pair<string, sg_int_t> > serialSeqs;
+  vector<pair<string, sg_int_t> > cladeSeqs;
+  for (sg_int_t i = 0; i < serialSg->getNumSequences(); ++i)
+  {
+    serialSeqs.push_back(pair<string, sg_int_t>(
+                           serialSg->getSequence(i)->getName(),
+                           serialSg->getSequence(i)->getLength()));
+  }
+  for (sg_int_t i = 0; i < cladeSg->getNumSequences(); ++i)
+  {
+    cladeSeqs.push_back(pair<string, sg_int_t>(
+                          cladeSg->getSequence(i)->getName(),
+                          cladeSg->getSequence(i)->getLength()));
+  }
+  sort(serialSeqs.begin(), serialSeqs.end());
+  sort(cladeSeqs.begin(), cladeSeqs.end());
+  CuAssertTrue(_testCase, cladeSeqs == serialSeqs);
+}
+
+void sgBuilderCladeMergeTest(CuTest *testCase)
+{
+  try
+  {
+    CladeMergeTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//     FUSED JOIN AND PATH EXPORT TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct FusedExportTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+static string readFile(const string& path)
+{
+  ifstream file(path.c_str());
+  stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+void FusedExportTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  const Genome* ancGenome = alignment->openGenome("AncGenome");
+  const Genome* leaf1Genome = alignment->openGenome("Leaf1");
+  const Genome* leaf2Genome = alignment->openGenome("Leaf2");
+
+  for (size_t t = 0; t < 2; ++t)
+  {
+    bool writeAncestralPaths = t == 0;
+    SGBuilder build;
+    build.init(alignment, ancGenome, false, false);
+    build.addGenome(ancGenome);
+    build.addGenome(leaf1Genome);
+    build.addGenome(leaf2Genome);
+    build.computeJoins(writeAncestralPaths);
+    HALSGSQL sqlWriter;
+    sqlWriter.exportGraph(&build, "fusedExportTest1.sql", 
+                          "fusedExportTest1.fa", "test.hal",
+                          writeAncestralPaths);
+
+    SGBuilder fusedBuild;
+    fusedBuild.init(alignment, ancGenome, false, false);
+    fusedBuild.addGenome(ancGenome);
+    fusedBuild.addGenome(leaf1Genome);
+    fusedBuild.addGenome(leaf2Genome);
+    HALSGSQL fusedSqlWriter;
+    fusedSqlWriter.computeJoinsAndExport(&fusedBuild, "fusedExportTest2.sql",
+                                         "fusedExportTest2.fa", "test.hal",
+                                         writeAncestralPaths);
+    
+    string sql = readFile("fusedExportTest1.sql");
+    CuAssertTrue(_testCase, sql.find("AllelePathItem") != string::npos);
+    CuAssertTrue(_testCase, sql == readFile("fusedExportTest2.sql"));
+    CuAssertTrue(_testCase, readFile("fusedExportTest1.fa") ==
+                 readFile("fusedExportTest2.fa"));
+    remove("fusedExportTest1.sql");
+    remove("fusedExportTest1.fa");
+    remove("fusedExportTest2.sql");
+    remove("fusedExportTest2.fa");
+
+    // lookups are gone
+    vector<SGSegment> path;
+    bool freed = false;
+    try
+    {
+      fusedBuild.getHalSequencePath(fusedBuild.getHalSequences()[0], path);
+    }
+    catch (hal_exception& e)
+    {
+      freed = true;
+    }
+    CuAssertTrue(_testCase, freed);
+  }
+}
+
+void sgBuilderFusedExportTest(CuTest *testCase)
+{
+  try
+  {
+    FusedExportTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//      PRELOADED TARGET DNA TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct PreloadTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void PreloadTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  const Genome* ancGenome = alignment->openGenome("AncGenome");
+  const Genome* leaf1Genome = alignment->openGenome("Leaf1");
+  const Genome* leaf2Genome = alignment->openGenome("Leaf2");
+
+  SGBuilder build;
+  build.init(alignment, ancGenome, false, false);
+  build.setDNACacheSize(0);
+  build.addGenome(ancGenome);
+  build.addGenome(leaf1Genome);
+  build.addGenome(leaf2Genome);
+  build.computeJoins();
+  CuAssertTrue(_testCase, build.getNumPreloadedGenomes() == 0);
+
+  SGBuilder preloadBuild;
+  preloadBuild.init(alignment, ancGenome, false, false);
+  preloadBuild.setMaxPreloadBytes(1 << 20);
+  preloadBuild.addGenome(ancGenome);
+  preloadBuild.addGenome(leaf1Genome);
+  preloadBuild.addGenome(leaf2Genome);
+  preloadBuild.computeJoins();
+  // both leaves map to the ancestor
+  CuAssertTrue(_testCase, preloadBuild.getNumPreloadedGenomes() == 1);
+  CuAssertTrue(_testCase, preloadBuild.getPreloadBytes() > 0);
+
+  const SideGraph* sg = build.getSideGraph();
+  const SideGraph* preloadSg = preloadBuild.getSideGraph();
+  CuAssertTrue(_testCase, 
+               sg->getNumSequences() == preloadSg->getNumSequences());
+  CuAssertTrue(_testCase, 
+               sg->getJoinSet()->size() == preloadSg->getJoinSet()->size());
+  for (sg_int_t i = 0; i < sg->getNumSequences(); ++i)
+  {
+    string dna;
+    string preloadDNA;
+    build.getSequenceString(sg->getSequence(i), dna);
+    preloadBuild.getSequenceString(preloadSg->getSequence(i), preloadDNA);
+    CuAssertTrue(_testCase, dna == preloadDNA);
+  }
+}
+
+void sgBuilderPreloadTest(CuTest *testCase)
+{
+  try
+  {
+    PreloadTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//    LOOKUP SPILLING TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct MaxMemoryTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void MaxMemoryTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  vector<const Genome*> genomes;
+  genomes.push_back(alignment->openGenome("AncGenome"));
+  genomes.push_back(alignment->openGenome("Leaf1"));
+  genomes.push_back(alignment->openGenome("Leaf2"));
+
+  SGBuilder build;
+  build.init(alignment, genomes[0], false, false);
+  for (size_t i = 0; i < genomes.size(); ++i)
+  {
+    build.addGenome(genomes[i]);
+  }
+  build.computeJoins();
+
+  // every lookup gets spilled as soon as no other genome maps to it:
+  // Leaf1 after it's added, and Leaf2 then AncGenome at the end
+  SGBuilder spillBuild;
+  spillBuild.init(alignment, genomes[0], false, false);
+  spillBuild.setMaxMemory(1);
+  spillBuild.setGenomeOrder(genomes);
+  for (size_t i = 0; i < genomes.size(); ++i)
+  {
+    spillBuild.addGenome(genomes[i]);
+  }
+  CuAssertTrue(_testCase, spillBuild.getNumSpilledLookups() == 3);
+  spillBuild.computeJoins();
+
+  const SideGraph* sg = build.getSideGraph();
+  const SideGraph* spillSg = spillBuild.getSideGraph();
+  CuAssertTrue(_testCase, 
+               sg->getNumSequences() == spillSg->getNumSequences());
+  CuAssertTrue(_testCase, 
+               sg->getJoinSet()->size() == spillSg->getJoinSet()->size());
+  const vector<const Sequence*>& halSequences = build.getHalSequences();
+  CuAssertTrue(_testCase, 
+               halSequences.size() == spillBuild.getHalSequences().size());
+  for (size_t i = 0; i < halSequences.size(); ++i)
+  {
+    vector<SGSegment> path;
+    vector<SGSegment> spillPath;
+    build.getHalSequencePath(halSequences[i], path);
+    spillBuild.getHalSequencePath(halSequences[i], spillPath);
+    CuAssertTrue(_testCase, path.size() == spillPath.size());
+    for (size_t j = 0; j < path.size(); ++j)
+    {
+      CuAssertTrue(_testCase, path[j].getSide() == spillPath[j].getSide() &&
+                   path[j].getLength() == spillPath[j].getLength());
+    }
+  }
+}
+
+void sgBuilderMaxMemoryTest(CuTest *testCase)
+{
+  try
+  {
+    MaxMemoryTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//    CHECKPOINT / RESUME TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct CheckpointTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+   void checkSame(const SGBuilder& build, const SGBuilder& resumeBuild);
+};
+
+void CheckpointTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  vector<const Genome*> genomes;
+  genomes.push_back(alignment->openGenome("AncGenome"));
+  genomes.push_back(alignment->openGenome("Leaf1"));
+  genomes.push_back(alignment->openGenome("Leaf2"));
+  const char* checkpointPath = "checkpointTest.checkpoint";
+
+  SGBuilder build;
+  build.init(alignment, genomes[0], false, false);
+  for (size_t i = 0; i < genomes.size(); ++i)
+  {
+    build.addGenome(genomes[i]);
+  }
+  build.computeJoins();
+
+  // interrupted after the first two genomes
+  {
+    SGBuilder firstBuild;
+    firstBuild.init(alignment, genomes[0], false, false);
+    firstBuild.setCheckpointPath(checkpointPath);
+    firstBuild.addGenome(genomes[0]);
+    firstBuild.addGenome(genomes[1]);
+  }
+  
+  SGBuilder resumeBuild;
+  resumeBuild.init(alignment, genomes[0], false, false);
+  vector<const Genome*> restored = resumeBuild.resumeCheckpoint(
+    checkpointPath);
+  CuAssertTrue(_testCase, restored.size() == 2 && 
+               restored[0] == genomes[0] && restored[1] == genomes[1]);
+  resumeBuild.addGenome(genomes[2]);
+  resumeBuild.computeJoins();
+  checkSame(build, resumeBuild);
+
+  // the record of the last genome is now in the checkpoint too.  
+  // a partially written record after it is ignored
+  FILE* file = fopen(checkpointPath, "ab");
+  CuAssertTrue(_testCase, file != NULL);
+  sg_int_t length = 1000;
+  fwrite(&length, sizeof(length), 1, file);
+  fwrite("garbage", 1, 7, file);
+  fclose(file);
+
+  SGBuilder resumeBuild2;
+  resumeBuild2.init(alignment, genomes[0], false, false);
+  restored = resumeBuild2.resumeCheckpoint(checkpointPath);
+  CuAssertTrue(_testCase, restored.size() == 3);
+  resumeBuild2.computeJoins();
+  checkSame(build, resumeBuild2);
+
+  remove(checkpointPath);
+}
+
+void CheckpointTest::checkSame(const SGBuilder& build, 
+                               const SGBuilder& resumeBuild)
+{
+  const SideGraph* sg = build.getSideGraph();
+  const SideGraph* resumeSg = resumeBuild.getSideGraph();
+  CuAssertTrue(_testCase, 
+               sg->getNumSequences() == resumeSg->getNumSequences());
+  for (sg_int_t i = 0; i < sg->getNumSequences(); ++i)
+  {
+    CuAssertTrue(_testCase, sg->getSequence(i)->getLength() ==
+                 resumeSg->getSequence(i)->getLength());
+    CuAssertTrue(_testCase, sg->getSequence(i)->getName() ==
+                 resumeSg->getSequence(i)->getName());
+  }
+  CuAssertTrue(_testCase, 
+               sg->getJoinSet()->size() == resumeSg->getJoinSet()->size());
+  const vector<const Sequence*>& halSequences = build.getHalSequences();
+  CuAssertTrue(_testCase, 
+               halSequences.size() == resumeBuild.getHalSequences().size());
+  for (size_t i = 0; i < halSequences.size(); ++i)
+  {
+    vector<SGSegment> path;
+    vector<SGSegment> resumePath;
+    build.getHalSequencePath(halSequences[i], path);
+    resumeBuild.getHalSequencePath(halSequences[i], resumePath);
+    CuAssertTrue(_testCase, path.size() == resumePath.size());
+    for (size_t j = 0; j < path.size(); ++j)
+    {
+      CuAssertTrue(_testCase, path[j].getSide() == resumePath[j].getSide() &&
+                   path[j].getLength() == resumePath[j].getLength());
+    }
+  }
+}
+
+void sgBuilderCheckpointTest(CuTest *testCase)
+{
+  try
+  {
+    CheckpointTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//    LAZY SEQUENCE NAMES TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct LazyNamesTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void LazyNamesTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  vector<const Genome*> genomes;
+  genomes.push_back(alignment->openGenome("AncGenome"));
+  genomes.push_back(alignment->openGenome("Leaf1"));
+  genomes.push_back(alignment->openGenome("Leaf2"));
+
+  SGBuilder build;
+  build.init(alignment, genomes[0], false, false);
+  SGBuilder lazyBuild;
+  lazyBuild.init(alignment, genomes[0], false, false);
+  lazyBuild.setLazySequenceNames(true);
+  for (size_t i = 0; i < genomes.size(); ++i)
+  {
+    build.addGenome(genomes[i]);
+    lazyBuild.addGenome(genomes[i]);
+  }
+
+  const SideGraph* sg = build.getSideGraph();
+  const SideGraph* lazySg = lazyBuild.getSideGraph();
+  CuAssertTrue(_testCase, 
+               sg->getNumSequences() == lazySg->getNumSequences());
+  // ancestor plus snp sequences
+  CuAssertTrue(_testCase, sg->getNumSequences() > 1);
+  for (sg_int_t i = 0; i < lazySg->getNumSequences(); ++i)
+  {
+    CuAssertTrue(_testCase, sg->getSequence(i)->getName().empty() == false);
+    CuAssertTrue(_testCase, lazySg->getSequence(i)->getName().empty());
+  }
+  lazyBuild.nameSequences();
+  for (sg_int_t i = 0; i < lazySg->getNumSequences(); ++i)
+  {
+    CuAssertTrue(_testCase, sg->getSequence(i)->getName() == 
+                 lazySg->getSequence(i)->getName());
+  }
+}
+
+void sgBuilderLazyNamesTest(CuTest *testCase)
+{
+  try
+  {
+    LazyNamesTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//    SIDE GRAPH SEQUENCE DNA STORE TEST (use HarderSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct DNAStoreTester : public SGBuilder
+{
+   size_t getLookBackString(const SGSequence* sgSequence, string& outString)
+   {
+     return getLookBackSequenceString(sgSequence, outString, 0, -1, 0);
+   }
+   size_t getNumStored() const
+   {
+     size_t numStored = 0;
+     for (sg_int_t i = 0; i < _sg->getNumSequences(); ++i)
+     {
+       if (_sgDNA.get(i, _sg->getSequence(i)->getLength()) != NULL)
+       {
+         ++numStored;
+       }
+     }
+     return numStored;
+   }
+   size_t getNumSNPSequences() const
+   {
+     size_t numSNPSequences = 0;
+     for (sg_int_t i = 0; i < _sg->getNumSequences(); ++i)
+     {
+       if (isSNPSequence(i))
+       {
+         ++numSNPSequences;
+       }
+     }
+     return numSNPSequences;
+   }
+   void clearStored()
+   {
+     _sgDNA.clear();
+   }
+};
+
+struct DNAStoreTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void DNAStoreTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  const Genome* ancGenome = alignment->openGenome("AncGenome");
+  const Genome* leaf1Genome = alignment->openGenome("Leaf1");
+  const Genome* leaf2Genome = alignment->openGenome("Leaf2");
+
+  // store is off by default
+  DNAStoreTester noStoreBuild;
+  noStoreBuild.init(alignment, ancGenome, false, false);
+  noStoreBuild.addGenome(ancGenome);
+  noStoreBuild.addGenome(leaf1Genome);
+  noStoreBuild.addGenome(leaf2Genome);
+  CuAssertTrue(_testCase, noStoreBuild.getNumStored() == 0);
+  CuAssertTrue(_testCase, noStoreBuild.getSequenceDNABytes() == 0);
+
+  DNAStoreTester build;
+  build.init(alignment, ancGenome, false, false);
+  build.setMaxSequenceDNABytes(1 << 20);
+  build.addGenome(ancGenome);
+  build.addGenome(leaf1Genome);
+  build.addGenome(leaf2Genome);
+  // checks paths against HAL, reading the stored DNA
+  build.computeJoins();
+
+  const SideGraph* sg = build.getSideGraph();
+  // ancestor plus snp sequences, but only the snps' DNA was in hand
+  CuAssertTrue(_testCase, sg->getNumSequences() > 1);
+  CuAssertTrue(_testCase, build.getNumSNPSequences() > 0);
+  CuAssertTrue(_testCase, build.getNumStored() == 
+               build.getNumSNPSequences());
+  CuAssertTrue(_testCase, build.getSequenceDNABytes() > 0);
+  for (sg_int_t i = 0; i < sg->getNumSequences(); ++i)
+  {
+    string dna;
+    string halDNA;
+    build.getSequenceString(sg->getSequence(i), dna);
+    build.getLookBackString(sg->getSequence(i), halDNA);
+    CuAssertTrue(_testCase, dna == halDNA);
+  }
+
+  // batched fetch of everything that's not in the store
+  build.clearStored();
+  build.prefetchSequenceDNA();
+  CuAssertTrue(_testCase, build.getNumStored() == 
+               (size_t)sg->getNumSequences());
+  for (sg_int_t i = 0; i < sg->getNumSequences(); ++i)
+  {
+    string dna;
+    string halDNA;
+    build.getSequenceString(sg->getSequence(i), dna);
+    build.getLookBackString(sg->getSequence(i), halDNA);
+    CuAssertTrue(_testCase, dna == halDNA);
+  }
+}
+
+void sgBuilderDNAStoreTest(CuTest *testCase)
+{
+  try
+  {
+    DNAStoreTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////
 //
 //            BASIC REFERENCE DUPE TEST
@@ -1258,6 +1876,655 @@ void sgBuilderTransSNPTest(CuTest *testCase)
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+//
+//    MULTITHREADED BUILD TEST (use HarderSNP and TransSNP alignments)
+//
+///////////////////////////////////////////////////////////////////////////
+
+/** Add the genomes (in order) using numThreads threads.  Returns false
+ * if fewer threads were used, ie HDF5 isn't threadsafe */
+static bool buildWithThreads(SGBuilder& build, AlignmentConstPtr alignment,
+                             const string& halPath,
+                             const vector<const Genome*>& genomes,
+                             size_t numThreads)
+{
+  build.init(alignment, genomes[0], false, false);
+  build.setNumThreads(numThreads, halPath);
+  if (build.getNumThreads() != numThreads)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < genomes.size(); ++i)
+  {
+    build.addGenome(genomes[i]);
+  }
+  return true;
+}
+
+static void compareJoins(CuTest* testCase, const SideGraph* sg1,
+                         const SideGraph* sg2)
+{
+  const SideGraph::JoinSet* joins1 = sg1->getJoinSet();
+  const SideGraph::JoinSet* joins2 = sg2->getJoinSet();
+  CuAssertTrue(testCase, joins1->size() == joins2->size());
+  SideGraph::JoinSet::const_iterator i = joins1->begin();
+  SideGraph::JoinSet::const_iterator j = joins2->begin();
+  for (; i != joins1->end() && j != joins2->end(); ++i, ++j)
+  {
+    CuAssertTrue(testCase, (*i)->getSide1() == (*j)->getSide1());
+    CuAssertTrue(testCase, (*i)->getSide2() == (*j)->getSide2());
+  }
+}
+
+/** Check that two builds (after computeJoins()) have the same sequences,
+ * joins and paths */
+static void compareBuilds(CuTest* testCase, const SGBuilder& build1,
+                          const SGBuilder& build2)
+{
+  const SideGraph* sg1 = build1.getSideGraph();
+  const SideGraph* sg2 = build2.getSideGraph();
+  CuAssertTrue(testCase, sg1->getNumSequences() == sg2->getNumSequences());
+  for (sg_int_t i = 0; i < sg1->getNumSequences() &&
+          i < sg2->getNumSequences(); ++i)
+  {
+    const SGSequence* seq1 = sg1->getSequence(i);
+    const SGSequence* seq2 = sg2->getSequence(i);
+    CuAssertTrue(testCase, seq1->getName() == seq2->getName());
+    CuAssertTrue(testCase, seq1->getLength() == seq2->getLength());
+    string dna1, dna2;
+    build1.getSequenceString(seq1, dna1);
+    build2.getSequenceString(seq2, dna2);
+    CuAssertTrue(testCase, dna1 == dna2);
+  }
+
+  compareJoins(testCase, sg1, sg2);
+
+  const vector<const Sequence*>& halSeqs1 = build1.getHalSequences();
+  const vector<const Sequence*>& halSeqs2 = build2.getHalSequences();
+  CuAssertTrue(testCase, halSeqs1.size() == halSeqs2.size());
+  for (size_t i = 0; i < halSeqs1.size() && i < halSeqs2.size(); ++i)
+  {
+    CuAssertTrue(testCase, 
+                 halSeqs1[i]->getFullName() == halSeqs2[i]->getFullName());
+    vector<SGSegment> path1, path2;
+    build1.getHalSequencePath(halSeqs1[i], path1);
+    build2.getHalSequencePath(halSeqs2[i], path2);
+    CuAssertTrue(testCase, path1.size() == path2.size());
+    for (size_t j = 0; j < path1.size() && j < path2.size(); ++j)
+    {
+      CuAssertTrue(testCase, path1[j].getSide() == path2[j].getSide());
+      CuAssertTrue(testCase, path1[j].getLength() == path2[j].getLength());
+    }
+  }
+}
+
+/** Build with 1 thread and then with 2-4 threads and compare the graphs
+ * and their exports, with joins computed by computeJoins() and by 
+ * computeJoinsAndExport().  Does nothing if HDF5 isn't threadsafe */
+static void checkParallelBuild(CuTest* testCase, AlignmentConstPtr alignment,
+                               const string& halPath,
+                               const vector<const Genome*>& genomes)
+{
+  SGBuilder serialBuild;
+  buildWithThreads(serialBuild, alignment, halPath, genomes, 1);
+  serialBuild.computeJoins();
+  HALSGSQL serialSqlWriter;
+  serialSqlWriter.exportGraph(&serialBuild, "parallelBuildTest1.sql", 
+                              "parallelBuildTest1.fa", "test.hal");
+  string serialSql = readFile("parallelBuildTest1.sql");
+  string serialFa = readFile("parallelBuildTest1.fa");
+  remove("parallelBuildTest1.sql");
+  remove("parallelBuildTest1.fa");
+
+  for (size_t numThreads = 2; numThreads <= 4; ++numThreads)
+  {
+    SGBuilder build;
+    if (buildWithThreads(build, alignment, halPath, genomes, 
+                         numThreads) == false)
+    {
+      return;
+    }
+    build.computeJoins();
+    compareBuilds(testCase, serialBuild, build);
+    HALSGSQL sqlWriter;
+    sqlWriter.exportGraph(&build, "parallelBuildTest2.sql", 
+                          "parallelBuildTest2.fa", "test.hal");
+    CuAssertTrue(testCase, readFile("parallelBuildTest2.sql") == serialSql);
+    CuAssertTrue(testCase, readFile("parallelBuildTest2.fa") == serialFa);
+    remove("parallelBuildTest2.sql");
+    remove("parallelBuildTest2.fa");
+
+    // joins computed by the threads writing paths into a PathSink
+    SGBuilder fusedBuild;
+    buildWithThreads(fusedBuild, alignment, halPath, genomes, numThreads);
+    HALSGSQL fusedSqlWriter;
+    fusedSqlWriter.computeJoinsAndExport(&fusedBuild, 
+                                         "parallelBuildTest3.sql",
+                                         "parallelBuildTest3.fa", "test.hal");
+    compareJoins(testCase, serialBuild.getSideGraph(), 
+                 fusedBuild.getSideGraph());
+    CuAssertTrue(testCase, readFile("parallelBuildTest3.sql") == serialSql);
+    CuAssertTrue(testCase, readFile("parallelBuildTest3.fa") == serialFa);
+    remove("parallelBuildTest3.sql");
+    remove("parallelBuildTest3.fa");
+  }
+}
+
+struct ParallelHarderSNPTest : public HarderSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void ParallelHarderSNPTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+  vector<const Genome*> genomes;
+  genomes.push_back(alignment->openGenome("AncGenome"));
+  genomes.push_back(alignment->openGenome("Leaf1"));
+  genomes.push_back(alignment->openGenome("Leaf2"));
+  checkParallelBuild(_testCase, alignment, _checkPath, genomes);
+}
+
+struct ParallelTransSNPTest : public TransSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void ParallelTransSNPTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+  vector<const Genome*> genomes;
+  genomes.push_back(alignment->openGenome("AncGenome"));
+  genomes.push_back(alignment->openGenome("Mid"));
+  genomes.push_back(alignment->openGenome("Leaf1"));
+  genomes.push_back(alignment->openGenome("Leaf2"));
+  checkParallelBuild(_testCase, alignment, _checkPath, genomes);
+}
+
+void sgBuilderParallelBuildTest(CuTest *testCase)
+{
+  try
+  {
+    ParallelHarderSNPTest harderTester;
+    harderTester.check(testCase);
+    ParallelTransSNPTest transTester;
+    transTester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//       MAPPING READ AHEAD TEST (many sequences and a failing read)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct ManySequenceTest : public AlignmentTest
+{
+   void createCallBack(hal::AlignmentPtr alignment);
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+   static const size_t NumSequences = 24;
+   // sequence 0 has more blocks than the read ahead reads DNA for at once
+   static const size_t NumLongSegments = 600;
+};
+
+/** Fails to read the DNA of one HAL sequence in the extra threads */
+class FailingReadBuilder : public SGBuilder
+{
+public:
+   FailingReadBuilder(const string& failSequence) :
+     _failSequence(failSequence) {}
+protected:
+   void getBlockDNA(const Block* block, string& outSrcDNA,
+                    string& outTgtDNA, size_t reader) const
+   {
+     if (reader > 0 && block->_srcSeq->getName() == _failSequence)
+     {
+       throw hal_exception("test read error in " + _failSequence);
+     }
+     SGBuilder::getBlockDNA(block, outSrcDNA, outTgtDNA, reader);
+   }
+   string _failSequence;
+};
+
+void ManySequenceTest::createCallBack(AlignmentPtr alignment)
+{
+  Genome* ancGenome = alignment->addRootGenome("AncGenome", 0);
+  Genome* leafGenome = alignment->addLeafGenome("Leaf", "AncGenome", 0.1);
+
+  // sequence 0 has NumLongSegments 4-base segments, the rest two 10-base
+  // segments.  Every other segment is inverted so no blocks are merged.
+  vector<Sequence::Info> ancSeqVec;
+  vector<Sequence::Info> leafSeqVec;
+  vector<hal_size_t> segLengths;
+  for (size_t i = 0; i < NumSequences; ++i)
+  {
+    size_t numSegments = i == 0 ? NumLongSegments : 2;
+    size_t segLength = i == 0 ? 4 : 10;
+    segLengths.insert(segLengths.end(), numSegments, segLength);
+    stringstream ancName, leafName;
+    ancName << "AncSequence" << i;
+    leafName << "LeafSequence" << i;
+    ancSeqVec.push_back(Sequence::Info(ancName.str(),
+                                       numSegments * segLength, 
+                                       0, numSegments));
+    leafSeqVec.push_back(Sequence::Info(leafName.str(),
+                                        numSegments * segLength, 
+                                        numSegments, 0));
+  }
+  ancGenome->setDimensions(ancSeqVec);
+  leafGenome->setDimensions(leafSeqVec);
+
+  string dna = randDNA(ancGenome->getSequenceLength());
+  ancGenome->setString(dna);
+  string leafDNA;
+
+  TopSegmentIteratorPtr top = leafGenome->getTopSegmentIterator();
+  BottomSegmentIteratorPtr bottom = ancGenome->getBottomSegmentIterator();
+  hal_index_t pos = 0;
+  for (size_t i = 0; i < segLengths.size(); ++i)
+  {
+    bool reversed = i % 2 == 1;
+    string segDNA = dna.substr(pos, segLengths[i]);
+    if (reversed == true)
+    {
+      reverseComplement(segDNA);
+    }
+    leafDNA += segDNA;
+    bottom->bseg()->setTopParseIndex(NULL_INDEX);
+    bottom->bseg()->setChildIndex(0, i);
+    bottom->bseg()->setChildReversed(0, reversed);
+    bottom->bseg()->setCoordinates(pos, segLengths[i]);
+    top->tseg()->setBottomParseIndex(NULL_INDEX);
+    top->tseg()->setParentIndex(i);
+    top->tseg()->setCoordinates(pos, segLengths[i]);
+    top->tseg()->setParentReversed(reversed);
+    top->tseg()->setNextParalogyIndex(NULL_INDEX);
+    bottom->toRight();
+    top->toRight();
+    pos += segLengths[i];
+  }
+  leafGenome->setString(leafDNA);
+}
+
+void ManySequenceTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+  vector<const Genome*> genomes;
+  genomes.push_back(alignment->openGenome("AncGenome"));
+  genomes.push_back(alignment->openGenome("Leaf"));
+
+  SGBuilder serialBuild;
+  buildWithThreads(serialBuild, alignment, _checkPath, genomes, 1);
+  serialBuild.computeJoins();
+  CuAssertTrue(_testCase, serialBuild.getHalSequences().size() ==
+               2 * NumSequences);
+
+  // more sequences than the window of 2 x threads read ahead
+  SGBuilder build;
+  if (buildWithThreads(build, alignment, _checkPath, genomes, 4) == false)
+  {
+    return;
+  }
+  build.computeJoins();
+  compareBuilds(_testCase, serialBuild, build);
+
+  // a read error in the first (long) sequence, while its DNA is read in 
+  // batches, and in one far past the window.  The error must come out of
+  // addGenome() after the threads are stopped.
+  const char* failSequences[] = {"LeafSequence0", "LeafSequence20"};
+  for (size_t i = 0; i < 2; ++i)
+  {
+    FailingReadBuilder failBuild(failSequences[i]);
+    failBuild.init(alignment, genomes[0], false, false);
+    failBuild.setNumThreads(4, _checkPath);
+    failBuild.addGenome(genomes[0]);
+    bool failed = false;
+    try
+    {
+      failBuild.addGenome(genomes[1]);
+    }
+    catch (hal_exception& e)
+    {
+      failed = string(e.what()).find("test read error") != string::npos;
+    }
+    CuAssertTrue(_testCase, failed);
+  }
+}
+
+void sgBuilderManySequenceTest(CuTest *testCase)
+{
+  try
+  {
+    ManySequenceTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//         PATH VERIFICATION LEVELS TEST (use TransSNP alignment)
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct VerifyLevelTest : public TransSNPTest
+{
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void VerifyLevelTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  validateAlignment(alignment.get());
+
+  const Genome* ancGenome = alignment->openGenome("AncGenome");
+  const Genome* midGenome = alignment->openGenome("Mid");
+  const Genome* leaf1Genome = alignment->openGenome("Leaf1");
+  const Genome* leaf2Genome = alignment->openGenome("Leaf2");
+  const Genome* genomes[] = {ancGenome, midGenome, leaf1Genome, leaf2Genome};
+  SGBuilder::VerifyLevel levels[] = {SGBuilder::VerifyOff, 
+                                     SGBuilder::VerifySampled,
+                                     SGBuilder::VerifyStructural,
+                                     SGBuilder::VerifyFull};
+
+  size_t numJoins = 0;
+  for (size_t i = 0; i < 4; ++i)
+  {
+    SGBuilder sgBuild;
+    sgBuild.init(alignment, ancGenome);
+    CuAssertTrue(_testCase, sgBuild.getVerifyLevel() == SGBuilder::VerifyFull);
+    sgBuild.setVerifyLevel(levels[i]);
+    for (size_t j = 0; j < 4; ++j)
+    {
+      sgBuild.addGenome(genomes[j]);
+    }
+    // throws if a path doesn't check out
+    sgBuild.computeJoins();
+    if (i == 0)
+    {
+      numJoins = sgBuild.getSideGraph()->getJoinSet()->size();
+    }
+    CuAssertTrue(_testCase, 
+                 sgBuild.getSideGraph()->getJoinSet()->size() == numJoins);
+  }
+}
+
+void sgBuilderVerifyLevelTest(CuTest *testCase)
+{
+  try
+  {
+    VerifyLevelTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//            CUT BLOCKS TEST
+//
+///////////////////////////////////////////////////////////////////////////
+
+// exposes cutBlocks() and checks it against the original (std::set
+// based) implementation on random self-alignment blocks.
+struct CutBlocksTester : public SGBuilder
+{
+   typedef SGBuilder::Block Block;
+   typedef SGBuilder::BlockArena BlockArena;
+
+   struct RefBlockLess {
+      bool operator()(const Block* b1, const Block* b2) const
+      {
+        if (b1->_srcStart != b2->_srcStart)
+          return b1->_srcStart < b2->_srcStart;
+        if (b1->_srcEnd != b2->_srcEnd)
+          return b1->_srcEnd < b2->_srcEnd;
+        if (b1->_tgtStart != b2->_tgtStart)
+          return b1->_tgtStart < b2->_tgtStart;
+        return b1->_tgtEnd < b2->_tgtEnd;
+      }
+   };
+   
+   void cut(vector<Block*>& blocks, BlockArena& arena,
+            bool leaveExactOverlaps)
+   {
+     cutBlocks(blocks, arena, leaveExactOverlaps);
+   }
+
+   // original implementation (using a stable sort since the order
+   // of ties was never defined)
+   void refCut(vector<Block*>& blocks, bool leaveExactOverlaps)
+   {
+     set<hal_index_t> cutPoints;
+     for (size_t i = 0; i < blocks.size(); ++i)
+     {
+       cutPoints.insert(blocks[i]->_srcStart);
+       cutPoints.insert(blocks[i]->_srcEnd + 1);
+       if (blocks[i]->_srcSeq == blocks[i]->_tgtSeq)
+       {
+         cutPoints.insert(blocks[i]->_tgtStart);
+         cutPoints.insert(blocks[i]->_tgtEnd + 1);      
+       }
+     }
+     cutPoints.insert(numeric_limits<hal_index_t>::max());
+     vector<Block*> outBlocks;
+     for (size_t i = 0; i < blocks.size(); ++i)
+     {
+       set<hal_index_t>::iterator j = 
+          cutPoints.upper_bound(blocks[i]->_srcStart);
+       if (*j > blocks[i]->_srcEnd)
+       {
+         outBlocks.push_back(blocks[i]);
+       }
+       else
+       {
+         hal_index_t prev = blocks[i]->_srcStart;
+         hal_index_t curLen = 0;
+         hal_index_t blockLen = blocks[i]->_srcEnd - blocks[i]->_srcStart + 1;
+         for (set<hal_index_t>::iterator k = j; curLen < blockLen; ++k)
+         {
+           hal_index_t pos = min(*k, blocks[i]->_srcEnd + 1);
+           Block* block = new Block(*blocks[i]);
+           block->_srcStart = prev;
+           block->_srcEnd = pos - 1;
+           hal_index_t thisLen = block->_srcEnd - block->_srcStart + 1;
+           if (block->_reversed == false)
+           {
+             block->_tgtStart = blocks[i]->_tgtStart + curLen;
+           }
+           else
+           {
+             block->_tgtStart = blocks[i]->_tgtEnd - curLen - thisLen + 1;
+           }
+           block->_tgtEnd = block->_tgtStart + thisLen - 1;
+           curLen += thisLen;
+           prev = block->_srcEnd + 1;
+           outBlocks.push_back(block);
+         }
+         delete blocks[i];
+       }
+     }
+     stable_sort(outBlocks.begin(), outBlocks.end(), RefBlockLess());
+     blocks.clear();
+     for (size_t i = 0; i < outBlocks.size(); ++i)
+     {
+       if (leaveExactOverlaps == true || blocks.empty() ||
+           outBlocks[i]->_srcStart != blocks.back()->_srcStart)
+       {
+         blocks.push_back(outBlocks[i]);
+       }
+       else
+       {
+         delete outBlocks[i];
+       }
+     }
+   }
+};
+
+void sgBuilderCutBlocksTest(CuTest *testCase)
+{
+  typedef CutBlocksTester::Block Block;
+  CutBlocksTester tester;
+  CutBlocksTester::BlockArena arena;
+  srand(1010);
+  const hal_index_t seqLen = 20000;
+  const size_t numBlocks = 2000;
+
+  for (size_t t = 0; t < 2; ++t)
+  {
+    bool leaveExactOverlaps = t == 0;
+    vector<Block*> blocks;
+    vector<Block*> refBlocks;
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+      // self-alignment: NULL src and tgt sequences are equal
+      Block* block = arena.allocate();
+      hal_index_t len = 1 + rand() % 500;
+      block->_srcSeq = NULL;
+      block->_tgtSeq = NULL;
+      block->_srcStart = rand() % (seqLen - len);
+      block->_srcEnd = block->_srcStart + len - 1;
+      block->_tgtStart = rand() % (seqLen - len);
+      block->_tgtEnd = block->_tgtStart + len - 1;
+      block->_reversed = rand() % 2 == 1;
+      blocks.push_back(block);
+      refBlocks.push_back(new Block(*block));
+    }
+    
+    tester.refCut(refBlocks, leaveExactOverlaps);
+    tester.cut(blocks, arena, leaveExactOverlaps);
+
+    CuAssertTrue(testCase, blocks.size() == refBlocks.size());
+    for (size_t i = 0; i < blocks.size() && i < refBlocks.size(); ++i)
+    {
+      CuAssertTrue(testCase, blocks[i]->_srcStart == refBlocks[i]->_srcStart);
+      CuAssertTrue(testCase, blocks[i]->_srcEnd == refBlocks[i]->_srcEnd);
+      CuAssertTrue(testCase, blocks[i]->_tgtStart == refBlocks[i]->_tgtStart);
+      CuAssertTrue(testCase, blocks[i]->_tgtEnd == refBlocks[i]->_tgtEnd);
+      CuAssertTrue(testCase, blocks[i]->_reversed == refBlocks[i]->_reversed);
+    }
+    arena.reset();
+    for (size_t i = 0; i < refBlocks.size(); ++i)
+    {
+      delete refBlocks[i];
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////
+//
+//  GENOME TREE INDEX: CHECK AGAINST SPANNING TREE SEARCH OF OLD GETTARGET
+//
+///////////////////////////////////////////////////////////////////////////
+
+struct GenomeTreeIndexTest : public AlignmentTest
+{
+   void createCallBack(hal::AlignmentPtr alignment);
+   void checkCallBack(hal::AlignmentConstPtr alignment);
+};
+
+void GenomeTreeIndexTest::createCallBack(AlignmentPtr alignment)
+{
+  // ((((L1,L2)A3,L3)A2,(L4,(L5,L6,L7)A5)A4)A1,L8)A0
+  alignment->addRootGenome("A0", 0);
+  alignment->addLeafGenome("A1", "A0", 0.1);
+  alignment->addLeafGenome("L8", "A0", 0.1);
+  alignment->addLeafGenome("A2", "A1", 0.1);
+  alignment->addLeafGenome("A4", "A1", 0.1);
+  alignment->addLeafGenome("A3", "A2", 0.1);
+  alignment->addLeafGenome("L3", "A2", 0.1);
+  alignment->addLeafGenome("L1", "A3", 0.1);
+  alignment->addLeafGenome("L2", "A3", 0.1);
+  alignment->addLeafGenome("L4", "A4", 0.1);
+  alignment->addLeafGenome("A5", "A4", 0.1);
+  alignment->addLeafGenome("L5", "A5", 0.1);
+  alignment->addLeafGenome("L6", "A5", 0.1);
+  alignment->addLeafGenome("L7", "A5", 0.1);
+}
+
+void GenomeTreeIndexTest::checkCallBack(AlignmentConstPtr alignment)
+{
+  const char* names[] = {"L5", "A0", "L3", "L1", "A4", "L7", "A1", "L2",
+                         "L8", "A5", "A3", "L4", "A2", "L6"};
+  const size_t numGenomes = 14;
+  vector<const Genome*> genomes;
+  for (size_t i = 0; i < numGenomes; ++i)
+  {
+    genomes.push_back(alignment->openGenome(names[i]));
+    CuAssertTrue(_testCase, genomes.back() != NULL);
+  }
+
+  GenomeTreeIndex index;
+  index.init(alignment->openGenome(alignment->getRootName()));
+  map<string, const Genome*> marked;
+  
+  for (size_t i = 0; i < numGenomes; ++i)
+  {
+    for (size_t j = 0; j < numGenomes; ++j)
+    {
+      set<const Genome*> inputSet;
+      inputSet.insert(genomes[i]);
+      inputSet.insert(genomes[j]);
+      CuAssertTrue(_testCase, index.getLowestCommonAncestor(
+                     genomes[i], genomes[j]) == 
+                   getLowestCommonAncestor(inputSet));
+      set<const Genome*> spanningTree;
+      getGenomesInSpanningTree(inputSet, spanningTree);
+      CuAssertTrue(_testCase, index.getDistance(genomes[i], genomes[j]) ==
+                   spanningTree.size() - 1);
+    }
+
+    // nearest marked genome, by scanning names like getTarget used to
+    for (size_t j = 0; j < numGenomes; ++j)
+    {
+      size_t dist = numeric_limits<size_t>::max();
+      const Genome* best = NULL;
+      for (map<string, const Genome*>::iterator k = marked.begin(); 
+           k != marked.end(); ++k)
+      {
+        set<const Genome*> inputSet;
+        inputSet.insert(genomes[j]);
+        inputSet.insert(k->second);
+        set<const Genome*> spanningTree;
+        getGenomesInSpanningTree(inputSet, spanningTree);
+        if (spanningTree.size() > 1 && spanningTree.size() < dist)
+        {
+          dist = spanningTree.size();
+          best = k->second;
+        }
+      }
+      CuAssertTrue(_testCase, index.getNearestMarked(genomes[j]) == best);
+    }
+
+    index.mark(genomes[i]);
+    marked.insert(pair<string, const Genome*>(names[i], genomes[i]));
+    CuAssertTrue(_testCase, index.isMarked(genomes[i]));
+  }
+}
+
+void sgBuilderGenomeTreeIndexTest(CuTest *testCase)
+{
+  try
+  {
+    GenomeTreeIndexTest tester;
+    tester.check(testCase);
+  }
+  catch (...) 
+  {
+    CuAssertTrue(testCase, false);
+  } 
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 CuSuite* sgBuildTestSuite(void) 
@@ -1270,8 +2537,20 @@ CuSuite* sgBuildTestSuite(void)
   SUITE_ADD_TEST(suite, sgBuilderEmptySequenceTest);
   SUITE_ADD_TEST(suite, sgBuilderSNPTest);
   SUITE_ADD_TEST(suite, sgBuilderHarderSNPTest);
+  SUITE_ADD_TEST(suite, sgBuilderCladeMergeTest);
+  SUITE_ADD_TEST(suite, sgBuilderFusedExportTest);
+  SUITE_ADD_TEST(suite, sgBuilderPreloadTest);
+  SUITE_ADD_TEST(suite, sgBuilderMaxMemoryTest);
+  SUITE_ADD_TEST(suite, sgBuilderCheckpointTest);
+  SUITE_ADD_TEST(suite, sgBuilderLazyNamesTest);
+  SUITE_ADD_TEST(suite, sgBuilderDNAStoreTest);
   SUITE_ADD_TEST(suite, sgBuilderRefDupeTest);
   SUITE_ADD_TEST(suite, sgBuilderTransInversionTest);
   SUITE_ADD_TEST(suite, sgBuilderTransSNPTest);
+  SUITE_ADD_TEST(suite, sgBuilderParallelBuildTest);
+  SUITE_ADD_TEST(suite, sgBuilderManySequenceTest);
+  SUITE_ADD_TEST(suite, sgBuilderVerifyLevelTest);
+  SUITE_ADD_TEST(suite, sgBuilderCutBlocksTest);
+  SUITE_ADD_TEST(suite, sgBuilderGenomeTreeIndexTest);
   return suite;
 }
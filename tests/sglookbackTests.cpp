@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 by Glenn Hickey (hickey@soe.ucsc.edu)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include <cstdio>
+#include <vector>
+#include "unitTests.h"
+#include "sglookback.h"
+
+using namespace std;
+
+// Intervals added in order, including merging of contiguous ones
+void sgLookBackMapTest(CuTest *testCase)
+{
+  SGLookBack lookBack;
+  const hal::Sequence* halSeq = NULL;
+
+  // seq 2: [0,10) -> hal [100,110) forward, [10,15) -> hal [110,115)
+  // forward (merged), [15,20) -> hal [50, 55) reversed
+  lookBack.addInterval(SGPosition(2, 0), halSeq, 100, 10, false);
+  lookBack.addInterval(SGPosition(2, 10), halSeq, 110, 5, false);
+  lookBack.addInterval(SGPosition(2, 15), halSeq, 50, 5, true);
+
+  pair<const hal::Sequence*, SGSide> mp;
+  mp = lookBack.mapPosition(SGPosition(2, 0));
+  CuAssertTrue(testCase, mp.second == SGSide(SGPosition(2, 100), true));
+  mp = lookBack.mapPosition(SGPosition(2, 12));
+  CuAssertTrue(testCase, mp.second == SGSide(SGPosition(2, 112), true));
+  mp = lookBack.mapPosition(SGPosition(2, 15));
+  CuAssertTrue(testCase, mp.second == SGSide(SGPosition(2, 54), false));
+  mp = lookBack.mapPosition(SGPosition(2, 19));
+  CuAssertTrue(testCase, mp.second == SGSide(SGPosition(2, 50), false));
+
+  vector<SGSegment> path;
+  vector<const hal::Sequence*> halSeqs;
+  lookBack.getPath(SGPosition(2, 0), 20, true, path, halSeqs);
+  CuAssertTrue(testCase, path.size() == 2);
+  CuAssertTrue(testCase, halSeqs.size() == 2);
+  CuAssertTrue(testCase, path[0].getSide() == SGSide(SGPosition(2, 100), 
+                                                     true));
+  CuAssertTrue(testCase, path[0].getLength() == 15);
+  CuAssertTrue(testCase, path[1].getSide() == SGSide(SGPosition(2, 54),
+                                                     false));
+  CuAssertTrue(testCase, path[1].getLength() == 5);
+  CuAssertTrue(testCase, path[1].getMinPos() == SGPosition(2, 50));
+
+  // sub range spanning both intervals, then reversed
+  lookBack.getPath(SGPosition(2, 13), 4, true, path, halSeqs);
+  CuAssertTrue(testCase, path.size() == 2);
+  CuAssertTrue(testCase, path[0].getSide() == SGSide(SGPosition(2, 113), 
+                                                     true));
+  CuAssertTrue(testCase, path[0].getLength() == 2);
+  CuAssertTrue(testCase, path[1].getSide() == SGSide(SGPosition(2, 54),
+                                                     false));
+  CuAssertTrue(testCase, path[1].getLength() == 2);
+
+  lookBack.getPath(SGPosition(2, 13), 4, false, path, halSeqs);
+  CuAssertTrue(testCase, path.size() == 2);
+  CuAssertTrue(testCase, path[0].getSide() == SGSide(SGPosition(2, 53), 
+                                                     true));
+  CuAssertTrue(testCase, path[0].getLength() == 2);
+  CuAssertTrue(testCase, path[1].getSide() == SGSide(SGPosition(2, 114),
+                                                     false));
+  CuAssertTrue(testCase, path[1].getLength() == 2);
+}
+
+// Intervals added out of order, and ranges that aren't covered
+void sgLookBackUnorderedTest(CuTest *testCase)
+{
+  SGLookBack lookBack;
+  const hal::Sequence* halSeq = NULL;
+
+  lookBack.addInterval(SGPosition(0, 20), halSeq, 20, 10, false);
+  lookBack.addInterval(SGPosition(0, 0), halSeq, 0, 5, false);
+  lookBack.addInterval(SGPosition(0, 10), halSeq, 300, 5, true);
+  lookBack.addInterval(SGPosition(0, 5), halSeq, 5, 5, false);
+
+  pair<const hal::Sequence*, SGSide> mp;
+  for (sg_int_t i = 0; i < 30; ++i)
+  {
+    mp = lookBack.mapPosition(SGPosition(0, i));
+    if (i >= 15 && i < 20)
+    {
+      CuAssertTrue(testCase, mp.second.getBase().getPos() == -1);
+    }
+    else if (i >= 10 && i < 15)
+    {
+      CuAssertTrue(testCase, mp.second == SGSide(SGPosition(0, 314 - i), 
+                                                 false));
+    }
+    else
+    {
+      CuAssertTrue(testCase, mp.second == SGSide(SGPosition(0, i), true));
+    }
+  }
+
+  vector<SGSegment> path;
+  vector<const hal::Sequence*> halSeqs;
+  lookBack.getPath(SGPosition(0, 0), 35, true, path, halSeqs);
+  CuAssertTrue(testCase, path.size() == 6);
+  CuAssertTrue(testCase, path[0].getSide() == SGSide(SGPosition(0, 0), true));
+  CuAssertTrue(testCase, path[0].getLength() == 5);
+  CuAssertTrue(testCase, path[1].getSide() == SGSide(SGPosition(0, 5), true));
+  CuAssertTrue(testCase, path[1].getLength() == 5);
+  CuAssertTrue(testCase, path[2].getSide() == SGSide(SGPosition(0, 304), 
+                                                     false));
+  CuAssertTrue(testCase, path[2].getLength() == 5);
+  CuAssertTrue(testCase, path[3].getMinPos().getPos() < 0);
+  CuAssertTrue(testCase, halSeqs[3] == NULL);
+  CuAssertTrue(testCase, path[3].getLength() == 5);
+  CuAssertTrue(testCase, path[4].getSide() == SGSide(SGPosition(0, 20), 
+                                                     true));
+  CuAssertTrue(testCase, path[4].getLength() == 10);
+  CuAssertTrue(testCase, path[5].getMinPos().getPos() < 0);
+  CuAssertTrue(testCase, path[5].getLength() == 5);
+
+  lookBack.clear();
+  lookBack.addInterval(SGPosition(0, 0), halSeq, 7, 1, true);
+  lookBack.getPath(SGPosition(0, 0), 1, true, path, halSeqs);
+  CuAssertTrue(testCase, path.size() == 1);
+  CuAssertTrue(testCase, path[0].getSide() == SGSide(SGPosition(0, 7), 
+                                                     false));
+}
+
+CuSuite* sgLookBackTestSuite(void) 
+{
+  CuSuite* suite = CuSuiteNew();
+  SUITE_ADD_TEST(suite, sgLookBackMapTest);
+  SUITE_ADD_TEST(suite, sgLookBackUnorderedTest);
+  return suite;
+}
@@ -57,6 +57,53 @@ void snpMapTest(CuTest *testCase)
   CuAssertTrue(testCase, snpHandlerCS.findSNP(p2, 'A') == p2);
 }
 
+/** walk along a sequence with a cursor, and with getNextSNP() / 
+ * getPrevSNP()
+ */
+void snpCursorTest(CuTest *tc)
+{
+  SNPHandler snpHandler(NULL, false);
+  bool caught = false;
+  try
+  {
+    snpHandler.getNextSNP('A');
+  }
+  catch (...)
+  {
+    caught = true;
+  }
+  CuAssertTrue(tc, caught == true);
+
+  // snps at every third position of 0..29
+  for (sg_int_t i = 0; i < 30; i += 3)
+  {
+    snpHandler.addSNP(SGPosition(0, i), 'A', SGPosition(0, i));
+    snpHandler.addSNP(SGPosition(0, i), 'C', SGPosition(1, i));
+  }
+
+  SNPHandler::Cursor cursor(&snpHandler, SGPosition(0, 0));
+  for (sg_int_t i = 0; i < 40; ++i, cursor.toNext())
+  {
+    CuAssertTrue(tc, cursor.getPosition() == SGPosition(0, i));
+    CuAssertTrue(tc, cursor.hasSNP() == (i < 30 && i % 3 == 0));
+    CuAssertTrue(tc, cursor.findSNP('c') == (cursor.hasSNP() ? 
+                                             SGPosition(1, i) : 
+                                             SideGraph::NullPos));
+  }
+  cursor.toPosition(SGPosition(1, 27));
+  for (sg_int_t i = 27; i >= 0; --i, cursor.toPrev())
+  {
+    CuAssertTrue(tc, cursor.hasSNP() == (i % 3 == 0));
+  }
+
+  CuAssertTrue(tc, snpHandler.findSNP(SGPosition(0, 11), 'A') ==
+               SideGraph::NullPos);
+  CuAssertTrue(tc, snpHandler.getNextSNP('A') == SGPosition(0, 12));
+  CuAssertTrue(tc, snpHandler.getNextSNP('A') == SideGraph::NullPos);
+  CuAssertTrue(tc, snpHandler.getPrevSNP('C') == SGPosition(1, 12));
+  CuAssertTrue(tc, snpHandler.getPrevSNP('C') == SideGraph::NullPos);
+}
+
 /** easiest case: we add a single SNP
  */
 void snpHandlerSingleSNPTest(CuTest *testCase)
@@ -399,13 +446,125 @@ void snpHandlerInversionSNPTest(CuTest *tc)
 
 }
 
+/** many sites, with more alleles than fit in a site, through several
+ * resizes of the hash table 
+ */
+void snpMapOverflowTest(CuTest *tc)
+{
+  SNPHandler snpHandler(NULL, true);
+  const char* nucs = "ACGTNacgtn";
+  const sg_int_t numSites = 5000;
+  for (sg_int_t i = 0; i < numSites; ++i)
+  {
+    SGPosition pos(0, i);
+    for (sg_int_t j = 0; j < 10; ++j)
+    {
+      snpHandler.addSNP(pos, nucs[j], j == 0 ? pos : SGPosition(j, i));
+    }
+  }
+  for (sg_int_t i = numSites - 1; i >= 0; --i)
+  {
+    SGPosition pos(0, i);
+    CuAssertTrue(tc, snpHandler.findSNP(pos, 'A') == pos);
+    for (sg_int_t j = 1; j < 10; ++j)
+    {
+      CuAssertTrue(tc, snpHandler.findSNP(pos, nucs[j]) == SGPosition(j, i));
+      // every allele position shares the site
+      CuAssertTrue(tc, snpHandler.findSNP(SGPosition(j, i), 'A') == pos);
+      char nuc;
+      char anchorNuc;
+      SGPosition anchor;
+      CuAssertTrue(tc, snpHandler.getSNPAnchor(SGPosition(j, i), nuc,
+                                               anchor, anchorNuc) == true);
+      CuAssertTrue(tc, nuc == nucs[j] && anchor == pos && anchorNuc == 'A');
+    }
+    CuAssertTrue(tc, snpHandler.findSNP(pos, 'R') == SideGraph::NullPos);
+    char nuc;
+    char anchorNuc;
+    SGPosition anchor;
+    CuAssertTrue(tc, snpHandler.getSNPAnchor(pos, nuc, anchor,
+                                             anchorNuc) == false);
+  }
+  CuAssertTrue(tc, snpHandler.findSNP(SGPosition(0, numSites), 'A') ==
+               SideGraph::NullPos);
+}
+
+/** once its scratch buffers are big enough, createSNP() doesn't grow 
+ * them any more
+ */
+void snpHandlerScratchTest(CuTest *tc)
+{
+  SideGraph sg;
+  sg.addSequence(new SGSequence(-1, 100000, "Seq0"));
+  SGLookup lookup;
+  const hal::Sequence* halSeq = NULL;
+  vector<string> seqNames;
+  seqNames.push_back("Seq0");
+  seqNames.push_back("Seq1");  
+  lookup.init(seqNames);
+  SNPHandler snpHandler(&sg);
+
+  string srcDNA = "ACGTACGTAC";
+  string tgtDNA = "CATGCATGCA";
+  snpHandler.createSNP(srcDNA, tgtDNA, 0, 10, halSeq, SGPosition(1, 0),
+                       SGPosition(0, 0), false, false, &lookup, NULL);
+  CuAssertTrue(tc, sg.getSequence(1)->getName() == "_0_10");
+  size_t numAllocations = snpHandler.getNumScratchAllocations();
+  CuAssertTrue(tc, numAllocations > 0);
+  for (sg_int_t i = 1; i < 5000; ++i)
+  {
+    snpHandler.createSNP(srcDNA, tgtDNA, i % 3, 10 - i % 3, halSeq,
+                         SGPosition(1, 20 * i), SGPosition(0, 20 * i),
+                         i % 2 == 0, false, &lookup, NULL);
+  }
+  CuAssertTrue(tc, snpHandler.getNumScratchAllocations() == numAllocations);
+  CuAssertTrue(tc, sg.getSequence(sg.getNumSequences() - 1)->getName() ==
+               "_99980_9");
+}
+
+// SNP sequences are left unnamed (and not recorded for lazy naming)
+// when names are stripped
+void snpHandlerStripNamesTest(CuTest *tc)
+{
+  SideGraph sg;
+  sg.addSequence(new SGSequence(-1, 100, "Seq0"));
+  SGLookup lookup;
+  const hal::Sequence* halSeq = NULL;
+  vector<string> seqNames;
+  seqNames.push_back("Seq0");
+  seqNames.push_back("Seq1");  
+  lookup.init(seqNames);
+  SGSeqNames sgSeqNames;
+  SNPHandler snpHandler(&sg);
+  snpHandler.setSeqNames(&sgSeqNames);
+  snpHandler.setStripNames(true);
+
+  string srcDNA = "ACGTACGTAC";
+  string tgtDNA = "CATGCATGCA";
+  snpHandler.createSNP(srcDNA, tgtDNA, 0, 10, halSeq, SGPosition(1, 0),
+                       SGPosition(0, 0), false, false, &lookup, NULL);
+  CuAssertTrue(tc, sg.getNumSequences() > 1);
+  CuAssertTrue(tc, sg.getSequence(1)->getName().empty());
+  CuAssertTrue(tc, sgSeqNames.hasOrigin(1) == false);
+
+  snpHandler.setSeqNames(NULL);
+  snpHandler.createSNP(srcDNA, tgtDNA, 0, 10, halSeq, SGPosition(1, 20),
+                       SGPosition(0, 20), false, false, &lookup, NULL);
+  CuAssertTrue(tc, sg.getSequence(sg.getNumSequences() - 1)->getName().
+               empty());
+}
+
 CuSuite* snpHandlerTestSuite(void) 
 {
   CuSuite* suite = CuSuiteNew();
   SUITE_ADD_TEST(suite, snpMapTest);
+  SUITE_ADD_TEST(suite, snpMapOverflowTest);
+  SUITE_ADD_TEST(suite, snpCursorTest);
   SUITE_ADD_TEST(suite, snpHandlerSingleSNPTest);
   SUITE_ADD_TEST(suite, snpHandlerMultibaseSNPTest);
   SUITE_ADD_TEST(suite, snpHandlerOverlapSNPTest);
   SUITE_ADD_TEST(suite, snpHandlerInversionSNPTest);
+  SUITE_ADD_TEST(suite, snpHandlerScratchTest);
+  SUITE_ADD_TEST(suite, snpHandlerStripNamesTest);
   return suite;
 }
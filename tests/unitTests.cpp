@@ -11,7 +11,11 @@
 int runAllTests(void) {
   CuString *output = CuStringNew();
   CuSuite* suite = CuSuiteNew(); 
+  CuSuiteAddSuite(suite, dnaKernelTestSuite());
+  CuSuiteAddSuite(suite, dnaCacheTestSuite());
+  CuSuiteAddSuite(suite, packedDNATestSuite());
   CuSuiteAddSuite(suite, snpHandlerTestSuite());
+  CuSuiteAddSuite(suite, sgLookBackTestSuite());
   CuSuiteAddSuite(suite, sgBuildTestSuite());
   CuSuiteRun(suite);
   CuSuiteSummary(suite, output);
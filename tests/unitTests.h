@@ -13,5 +13,9 @@ extern "C" {
 
 CuSuite* sgBuildTestSuite();
 CuSuite* snpHandlerTestSuite();
+CuSuite* sgLookBackTestSuite();
+CuSuite* dnaKernelTestSuite();
+CuSuite* dnaCacheTestSuite();
+CuSuite* packedDNATestSuite();
 
 #endif